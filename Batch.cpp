@@ -0,0 +1,145 @@
+#include "Batch.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <thread>
+
+
+std::vector<BatchJob> read_batch_jobs(const std::string& path, const std::string& out_dir, float factor)
+{
+	namespace fs = std::filesystem;
+
+	std::vector<BatchJob> jobs;
+	if (fs::is_directory(path))
+	{
+		if (out_dir.empty() || factor < 0.f)
+		{
+			throw std::invalid_argument("Error: Batching a directory needs -f and -o <output-directory>");
+		}
+		fs::create_directories(out_dir);
+
+		for (const fs::directory_entry& entry : fs::directory_iterator(path))
+		{
+			std::string extension = entry.path().extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(),
+						   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			if (entry.is_regular_file() && extension == ".tga")
+			{
+				jobs.push_back({ entry.path().string(), (fs::path(out_dir) / entry.path().filename()).string(), factor });
+			}
+		}
+		// Directory order is whatever the filesystem likes, sorting keeps the runs (and their logs) reproducible
+		std::sort(jobs.begin(), jobs.end(), [](const BatchJob& lhs, const BatchJob& rhs) { return lhs.in_path < rhs.in_path; });
+		return jobs;
+	}
+
+	// Every line of a manifest has its own output and factor, -f and -o would just be ignored
+	if (!out_dir.empty() || factor >= 0.f)
+	{
+		throw std::invalid_argument("Error: -f and -o are not available with a batch manifest");
+	}
+	std::ifstream manifest(path);
+	if (manifest.fail())
+	{
+		throw std::ios_base::failure("Unable to open batch manifest for reading");
+	}
+	std::string line;
+	for (int line_number = 1; std::getline(manifest, line); line_number++)
+	{
+		std::istringstream fields(line);
+		BatchJob job;
+		std::string extra;
+		if (!(fields >> job.in_path) || job.in_path[0] == '#')
+		{
+			continue;
+		}
+		if (!(fields >> job.out_path >> job.factor) || (fields >> extra))
+		{
+			char buffer[100];
+			snprintf(buffer, sizeof(buffer), "Error: Line %d of the manifest is not \"input output factor\"", line_number);
+			throw std::invalid_argument(buffer);
+		}
+		jobs.push_back(job);
+	}
+	return jobs;
+}
+
+BatchTotals run_batch(const std::vector<BatchJob>& jobs, int workers, BlurEngine engine, BlurMode mode, std::ostream& log,
+					  StatsFormat stats_format)
+{
+	BatchTotals totals;
+	std::atomic<size_t> next_job(0);
+	std::mutex totals_mutex;
+
+	const auto start = std::chrono::steady_clock::now();
+	auto worker = [&]()
+	{
+		// Parsing into the same image over and over keeps its pixel buffer (and the blur scratch, per thread)
+		TGA image(engine);
+		BlurStats stats;
+		if (stats_format != StatsFormat::NONE)
+		{
+			image.set_stats(&stats);
+		}
+		for (size_t i = next_job++; i < jobs.size(); i = next_job++)
+		{
+			const BatchJob& job = jobs[i];
+			std::string error;
+			stats = BlurStats();
+			try
+			{
+				image.parse(job.in_path);
+				image.blur(job.factor, 1, mode);
+				image.write(job.out_path);
+			}
+			catch (std::exception& e)
+			{
+				error = e.what();
+			}
+			catch (...)
+			{
+				error = "Unknown error";
+			}
+
+			std::lock_guard<std::mutex> lock(totals_mutex);
+			if (error.empty())
+			{
+				totals.done++;
+				totals.pixels += static_cast<long long>(image.get_width()) * image.get_height();
+				if (stats_format != StatsFormat::NONE)
+				{
+					log << format_stats(stats, stats_format, job.in_path) << std::endl;
+				}
+			}
+			else
+			{
+				totals.failed++;
+				log << "Failed " << job.in_path << ": " << error << std::endl;
+			}
+		}
+	};
+
+	const int count = std::max(1, std::min(workers, static_cast<int>(jobs.size())));
+	std::vector<std::thread> pool;
+	pool.reserve(count - 1);
+	for (int w = 1; w < count; w++)
+	{
+		pool.emplace_back(worker);
+	}
+	// The calling thread is one of the workers
+	worker();
+	for (std::thread& t : pool)
+	{
+		t.join();
+	}
+
+	totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return totals;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "BlurringFilter.h"
+#include "BlurStats.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+struct BatchJob
+{
+	std::string in_path;
+	std::string out_path;
+	float factor;
+};
+
+struct BatchTotals
+{
+	int done = 0;
+	int failed = 0;
+	long long pixels = 0;
+	double seconds = 0.0;
+};
+
+// A directory gives one job per .tga file in it, written with the same name in out_dir and blurred by factor.
+// Anything else is read as a manifest, one "input output factor" job per line (empty lines and lines starting
+// with # are skipped), out_dir has to be empty and factor negative then.
+std::vector<BatchJob> read_batch_jobs(const std::string& path, const std::string& out_dir, float factor);
+
+// Runs the jobs on a pool of workers, each one with its own TGA (and buffers) reused from image to image.
+// A failing image is reported on log and doesn't stop the others, with a stats format every image gets its
+// report line there too.
+BatchTotals run_batch(const std::vector<BatchJob>& jobs, int workers, BlurEngine engine, BlurMode mode, std::ostream& log,
+					  StatsFormat stats_format = StatsFormat::NONE);
@@ -0,0 +1,844 @@
+#include "BlurringFilter.h"
+#include "BlurKernels.h"
+#include "BlurStats.h"
+#include "IncrementalBlur.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+
+// Benchmark of the whole pipeline on synthetic images, one CSV line per image and blur factor on stdout:
+//
+// BlurringBenchmark [--sizes 640x480,1920x1080,...] [--depths 8,24,32] [--factors 0.01,0.1,...] [--engine float|int|planar]
+//                   [--mode box|sat|gaussian|approx] [--tolerance <t>] [-j <threads>] [--isa <isa>] [--repeat <n>] [--rle]
+//                   [--dir <dir>]
+// BlurringBenchmark --verify [--dir <dir>]
+//
+// Every line reports the fastest of --repeat runs, the approximate mode also its downsampling scale and its PSNR
+// against the box blur. --verify checks on small images instead: the modes against the reference blur (and the
+// streaming blur against the in-memory one), blurred regions and incremental blurs against the whole image blur,
+// multiple factor blurs against single factor ones, and run-length encoded outputs against uncompressed ones. Then the
+// PSNR of the approximate mode on larger ones, exiting with 1 on a mismatch.
+
+struct ImageSize
+{
+	int width;
+	int height;
+};
+
+struct BenchmarkOptions
+{
+	std::vector<ImageSize> sizes = { { 640, 480 }, { 1920, 1080 }, { 3840, 2160 }, { 1000, 10 }, { 4096, 1 }, { 1, 4096 } };
+	std::vector<int> depths = { 24, 32 };
+	std::vector<float> factors = { 0.01f, 0.05f, 0.1f, 0.25f, 0.5f, 0.75f, 1.f };
+	BlurEngine engine = BlurEngine::FLOAT;
+	BlurMode mode = BlurMode::BOX;
+	std::string mode_name = "box";
+	float tolerance = DEFAULT_BLUR_TOLERANCE;
+	int threads = 1;
+	int repeat = 3;
+	bool rle = false;
+	bool verify = false;
+	std::string dir;
+};
+
+static std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::istringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		items.push_back(item);
+	}
+	return items;
+}
+
+// Smooth gradients with some hashed noise on top, and a checkerboard of flat tiles so run-length encoding has
+// something to find
+static void get_synthetic_pixel(const int i, const int j, uint8_t* bgra)
+{
+	if (((i / 64) + (j / 64)) % 3 == 0)
+	{
+		bgra[0] = 40;
+		bgra[1] = 160;
+		bgra[2] = 220;
+		bgra[3] = 255;
+		return;
+	}
+	uint32_t hash = static_cast<uint32_t>(i) * 73856093u ^ static_cast<uint32_t>(j) * 19349663u;
+	hash ^= hash >> 13;
+	hash *= 0x5bd1e995u;
+	hash ^= hash >> 15;
+	bgra[0] = static_cast<uint8_t>((j * 255 / 512 + (hash & 0x3F)) & 0xFF);
+	bgra[1] = static_cast<uint8_t>((i * 255 / 512 + ((hash >> 8) & 0x3F)) & 0xFF);
+	bgra[2] = static_cast<uint8_t>(((i + j) / 4 + ((hash >> 16) & 0x3F)) & 0xFF);
+	bgra[3] = static_cast<uint8_t>(128 + ((hash >> 24) & 0x7F));
+}
+
+// Rows for the run-length encoder: a lone pixel and a pair of equal ones one after the other (its worst case for 1
+// byte pixels), no two equal neighbours at all (raw packets of 128 pixels, the worst case of the others) and a
+// single color (run packets of 128 pixels)
+static void get_worst_case_rle_pixel(const int i, const int j, uint8_t* bgra)
+{
+	const int value = (i % 3 == 0 ? 2 * (j / 3) + (j % 3 != 0) : i % 3 == 1 ? j * 37 + i : i);
+	memset(bgra, value & 0xFF, 4);
+}
+
+static void generate_tga(const std::string& path, const int width, const int height, const int depth, const bool rle,
+						 void (*get_pixel)(int, int, uint8_t*) = get_synthetic_pixel)
+{
+	// 8 bit images are mono, with the green channel as gray
+	const int bytes_per_pixel = depth / 8;
+	std::vector<uint8_t> file(18, 0);
+	file[2] = (depth == 8 ? (rle ? 0x0B : 0x03) : (rle ? 0x0A : 0x02));
+	file[12] = static_cast<uint8_t>(width & 0xFF);
+	file[13] = static_cast<uint8_t>(width >> 8);
+	file[14] = static_cast<uint8_t>(height & 0xFF);
+	file[15] = static_cast<uint8_t>(height >> 8);
+	file[16] = static_cast<uint8_t>(depth);
+	file[17] = static_cast<uint8_t>(depth == 32 ? 0x28 : 0x00); // Top-down with alpha bits, bottom-up without
+
+	std::vector<uint8_t> row(static_cast<size_t>(width) * bytes_per_pixel);
+	for (int i = 0; i < height; i++)
+	{
+		for (int j = 0; j < width; j++)
+		{
+			uint8_t bgra[4];
+			get_pixel(i, j, bgra);
+			memcpy(&row[static_cast<size_t>(j) * bytes_per_pixel], depth == 8 ? bgra + 1 : bgra, bytes_per_pixel);
+		}
+		if (!rle)
+		{
+			file.insert(file.end(), row.begin(), row.end());
+			continue;
+		}
+		// Run packets for the repeated pixels, raw packets for everything else
+		for (int j = 0; j < width;)
+		{
+			const uint8_t* pixel = &row[static_cast<size_t>(j) * bytes_per_pixel];
+			int count = 1;
+			while (j + count < width && count < 128 && memcmp(pixel, pixel + count * bytes_per_pixel, bytes_per_pixel) == 0)
+			{
+				count++;
+			}
+			if (count == 1)
+			{
+				while (j + count < width && count < 128 &&
+					   memcmp(pixel + (count - 1) * bytes_per_pixel, pixel + count * bytes_per_pixel, bytes_per_pixel) != 0)
+				{
+					count++;
+				}
+				file.push_back(static_cast<uint8_t>(count - 1));
+				file.insert(file.end(), pixel, pixel + count * bytes_per_pixel);
+			}
+			else
+			{
+				file.push_back(static_cast<uint8_t>(0x80 | (count - 1)));
+				file.insert(file.end(), pixel, pixel + bytes_per_pixel);
+			}
+			j += count;
+		}
+	}
+
+	// New TGA format footer, without extension area nor developer directory
+	file.insert(file.end(), 8, 0);
+	const std::string signature = TGA::SIGNATURE;
+	file.insert(file.end(), signature.begin(), signature.end());
+	file.push_back('.');
+	file.push_back(0x00);
+
+	std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+	ofs.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+	if (ofs.fail())
+	{
+		throw std::ios_base::failure("Unable to write the synthetic image");
+	}
+}
+
+static std::string get_image_path(const std::string& dir, const ImageSize& size, const int depth, const bool rle)
+{
+	char name[100];
+	snprintf(name, sizeof(name), "synthetic_%dx%d_%d%s.tga", size.width, size.height, depth, rle ? "_rle" : "");
+	return (std::filesystem::path(dir) / name).string();
+}
+
+static std::vector<uint8_t> read_file(const std::string& path)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+// Largest difference between the pixel bytes of two uncompressed outputs of the same image
+static int get_max_difference(const std::string& lhs_path, const std::string& rhs_path, const ImageSize& size, const int depth)
+{
+	const std::vector<uint8_t> lhs = read_file(lhs_path);
+	const std::vector<uint8_t> rhs = read_file(rhs_path);
+	const size_t end = 18 + static_cast<size_t>(size.width) * size.height * (depth / 8);
+	if (lhs.size() < end || rhs.size() < end)
+	{
+		return 256;
+	}
+	int max_difference = 0;
+	for (size_t i = 18; i < end; i++)
+	{
+		max_difference = std::max(max_difference, std::abs(static_cast<int>(lhs[i]) - static_cast<int>(rhs[i])));
+	}
+	return max_difference;
+}
+
+// Largest difference between the pixels of an uncompressed output and the ones the packets of a run-length encoded
+// output of the same image decode to. The packets have to end right before the 26 byte footer.
+static int get_max_rle_difference(const std::string& raw_path, const std::string& rle_path, const ImageSize& size, const int depth)
+{
+	const std::vector<uint8_t> raw = read_file(raw_path);
+	const std::vector<uint8_t> rle = read_file(rle_path);
+	const size_t bytes_per_pixel = depth / 8;
+	const size_t end = 18 + static_cast<size_t>(size.width) * size.height * bytes_per_pixel;
+	if (raw.size() < end)
+	{
+		return 256;
+	}
+	int max_difference = 0;
+	size_t pos = 18;
+	for (size_t i = 18; i < end;)
+	{
+		if (pos >= rle.size())
+		{
+			return 256;
+		}
+		const size_t count = (rle[pos] & 0x7F) + 1;
+		const bool run = (rle[pos++] & 0x80) != 0;
+		if (i + count * bytes_per_pixel > end || pos + (run ? 1 : count) * bytes_per_pixel > rle.size())
+		{
+			return 256;
+		}
+		for (size_t k = 0; k < count * bytes_per_pixel; k++)
+		{
+			const int value = rle[pos + (run ? k % bytes_per_pixel : k)];
+			max_difference = std::max(max_difference, std::abs(value - static_cast<int>(raw[i + k])));
+		}
+		i += count * bytes_per_pixel;
+		pos += (run ? 1 : count) * bytes_per_pixel;
+	}
+	return pos + 26 == rle.size() ? max_difference : 256;
+}
+
+// Largest difference between an uncompressed output blurred only inside rect (in the file order of the rows and
+// columns) and what it should be: the pixels of the whole image blur inside, the ones of the input outside
+static int get_max_roi_difference(const std::string& in_path, const std::string& blurred_path, const std::string& roi_path,
+								  const ImageSize& size, const int depth, const BlurRect& rect)
+{
+	const std::vector<uint8_t> input = read_file(in_path);
+	const std::vector<uint8_t> blurred = read_file(blurred_path);
+	const std::vector<uint8_t> roi = read_file(roi_path);
+	const int bytes_per_pixel = depth / 8;
+	const size_t end = 18 + static_cast<size_t>(size.width) * size.height * bytes_per_pixel;
+	if (input.size() < end || blurred.size() < end || roi.size() < end)
+	{
+		return 256;
+	}
+	int max_difference = 0;
+	for (int i = 0; i < size.height; i++)
+	{
+		for (int j = 0; j < size.width; j++)
+		{
+			const bool inside = i >= rect.y && i < rect.y + rect.height && j >= rect.x && j < rect.x + rect.width;
+			const std::vector<uint8_t>& expected = (inside ? blurred : input);
+			const size_t offset = 18 + (static_cast<size_t>(i) * size.width + j) * bytes_per_pixel;
+			for (int k = 0; k < bytes_per_pixel; k++)
+			{
+				max_difference = std::max(max_difference, std::abs(static_cast<int>(expected[offset + k]) - static_cast<int>(roi[offset + k])));
+			}
+		}
+	}
+	return max_difference;
+}
+
+// Largest difference between the bytes of the pixels of two views of the same size and layout
+static int get_max_difference(const ImageView& lhs, const ImageView& rhs)
+{
+	if (lhs.width != rhs.width || lhs.height != rhs.height || lhs.layout != rhs.layout)
+	{
+		return 256;
+	}
+	const size_t row_size = static_cast<size_t>(lhs.width) * get_pixel_size(lhs.layout);
+	int max_difference = 0;
+	for (int i = 0; i < lhs.height * get_plane_count(lhs.layout); i++)
+	{
+		const uint8_t* lhs_row = lhs.get_row(i);
+		const uint8_t* rhs_row = rhs.get_row(i);
+		for (size_t j = 0; j < row_size; j++)
+		{
+			max_difference = std::max(max_difference, std::abs(static_cast<int>(lhs_row[j]) - static_cast<int>(rhs_row[j])));
+		}
+	}
+	return max_difference;
+}
+
+// Copies the pixels of src inside rect over the ones of dst (same size and layout)
+static void copy_region(const ImageView& src, const ImageView& dst, const BlurRect& rect)
+{
+	const size_t pixel_size = get_pixel_size(src.layout);
+	for (int p = 0; p < get_plane_count(src.layout); p++)
+	{
+		for (int i = rect.y; i < rect.y + rect.height; i++)
+		{
+			memcpy(dst.get_plane(p) + i * dst.stride + rect.x * pixel_size, src.get_plane(p) + i * src.stride + rect.x * pixel_size,
+				   rect.width * pixel_size);
+		}
+	}
+}
+
+// Largest difference between the pixels of two float views of the same size and layout, in millionths
+static int get_max_float_difference(const ImageView& lhs, const ImageView& rhs)
+{
+	const size_t row_size = static_cast<size_t>(lhs.width) * get_pixel_size(lhs.layout) / sizeof(float);
+	float max_difference = 0.f;
+	for (int i = 0; i < lhs.height * get_plane_count(lhs.layout); i++)
+	{
+		const float* lhs_row = reinterpret_cast<const float*>(lhs.get_row(i));
+		const float* rhs_row = reinterpret_cast<const float*>(rhs.get_row(i));
+		for (size_t j = 0; j < row_size; j++)
+		{
+			max_difference = std::max(max_difference, std::abs(lhs_row[j] - rhs_row[j]));
+		}
+	}
+	return static_cast<int>(std::ceil(max_difference * 1e6f));
+}
+
+// Peak signal to noise ratio of one output against the other, in dB (infinite when they're the same)
+static double get_psnr(const std::string& reference_path, const std::string& path, const ImageSize& size, const int depth)
+{
+	const std::vector<uint8_t> reference = read_file(reference_path);
+	const std::vector<uint8_t> image = read_file(path);
+	const size_t end = 18 + static_cast<size_t>(size.width) * size.height * (depth / 8);
+	if (reference.size() < end || image.size() < end)
+	{
+		return 0.0;
+	}
+	double squares = 0.0;
+	for (size_t i = 18; i < end; i++)
+	{
+		const double difference = static_cast<double>(reference[i]) - image[i];
+		squares += difference * difference;
+	}
+	const double mse = squares / (end - 18);
+	return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+}
+
+static const char* get_engine_name(const BlurEngine engine)
+{
+	return engine == BlurEngine::INTEGER ? "int" : engine == BlurEngine::PLANAR ? "planar" : "float";
+}
+
+static void run_benchmark(const BenchmarkOptions& options)
+{
+	std::cout << "width,height,depth,encoding,engine,mode,isa,threads,factor,kernel_size,parse_ms,pad_ms,rows_ms,cols_ms,"
+				 "blur_ms,write_ms,total_ms,blur_mpix_s,blur_ns_per_pixel,total_mpix_s,peak_rss_kb,scale,psnr_db" << std::endl;
+
+	const std::string out_path = (std::filesystem::path(options.dir) / "benchmark_output.tga").string();
+	const std::string exact_path = (std::filesystem::path(options.dir) / "benchmark_exact.tga").string();
+	for (const ImageSize& size : options.sizes)
+	{
+		for (const int depth : options.depths)
+		{
+			const std::string in_path = get_image_path(options.dir, size, depth, options.rle);
+			generate_tga(in_path, size.width, size.height, depth, options.rle);
+
+			for (const float factor : options.factors)
+			{
+				BlurStats best;
+				double best_pad = 0.0;
+				for (int r = 0; r < options.repeat; r++)
+				{
+					BlurStats stats;
+					double pad = 0.0;
+					TGA image(options.engine);
+					image.set_stats(&stats);
+					image.set_tolerance(options.tolerance);
+					image.parse(in_path);
+					image.blur(factor, options.threads, options.mode);
+					if (image.get_view().layout == PixelLayout::RGBA_F32 && stats.kernel_size > 0)
+					{
+						// The blur itself doesn't need a padded copy anymore, this times the one the API still offers
+						ScopedTimer timer(&pad);
+						delete[] image.get_mirror_padded_image(stats.kernel_size / 2);
+					}
+					image.write(out_path);
+
+					if (r == 0 || stats.parse + stats.blur + stats.write < best.parse + best.blur + best.write)
+					{
+						best = stats;
+						best_pad = pad;
+					}
+				}
+
+				// The approximation error is measured outside of the timed runs
+				std::string psnr;
+				if (options.mode == BlurMode::APPROXIMATE)
+				{
+					TGA image(in_path, options.engine);
+					image.blur(factor, options.threads, BlurMode::BOX);
+					image.write(exact_path);
+					char value[32];
+					snprintf(value, sizeof(value), "%.2f", get_psnr(exact_path, out_path, size, depth));
+					psnr = value;
+				}
+
+				const double pixels = static_cast<double>(size.width) * size.height;
+				const double total = best.parse + best.blur + best.write;
+				char line[400];
+				snprintf(line, sizeof(line), "%d,%d,%d,%s,%s,%s,%s,%d,%.2f,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.3f,%.2f,%lld,%d,%s",
+						 size.width, size.height, depth, options.rle ? "rle" : "raw",
+						 get_engine_name(options.engine), options.mode_name.c_str(),
+						 get_blur_isa_name(get_blur_isa()).c_str(), options.threads, factor, best.kernel_size,
+						 best.parse * 1e3, best_pad * 1e3, best.blur_rows * 1e3, best.blur_cols * 1e3, best.blur * 1e3,
+						 best.write * 1e3, total * 1e3, best.blur > 0.0 ? pixels / best.blur / 1e6 : 0.0,
+						 best.blur * 1e9 / pixels, total > 0.0 ? pixels / total / 1e6 : 0.0, get_peak_working_set_kb(), best.scale,
+						 psnr.c_str());
+				std::cout << line << std::endl;
+			}
+			std::filesystem::remove(in_path);
+		}
+	}
+	std::filesystem::remove(out_path);
+	std::filesystem::remove(exact_path);
+}
+
+static bool run_verify(const BenchmarkOptions& options)
+{
+	// Small enough for the reference blur
+	const std::vector<ImageSize> sizes = { { 97, 61 }, { 64, 64 }, { 130, 9 }, { 5, 200 } };
+	const std::vector<float> factors = { 0.05f, 0.3f, 0.6f, 1.f };
+	const std::filesystem::path dir(options.dir);
+	const std::string reference_path = (dir / "verify_reference.tga").string();
+	const std::string out_path = (dir / "verify_output.tga").string();
+
+	bool ok = true;
+	auto check = [&](const char* name, const ImageSize& size, const int depth, const char* engine, const float factor,
+					 const int max_difference, const int tolerance)
+	{
+		const bool passed = max_difference <= tolerance;
+		ok = ok && passed;
+		char line[200];
+		snprintf(line, sizeof(line), "verify,%s,%dx%d,%d,%s,%.2f,%d,%s", name, size.width, size.height, depth, engine, factor,
+				 max_difference, passed ? "ok" : "FAIL");
+		std::cout << line << std::endl;
+	};
+
+	std::cout << "verify,check,size,depth,engine,factor,max_difference,result" << std::endl;
+	for (const ImageSize& size : sizes)
+	{
+		for (const int depth : { 8, 24, 32 })
+		{
+			const std::string in_path = get_image_path(options.dir, size, depth, false);
+			generate_tga(in_path, size.width, size.height, depth, false);
+			for (const float factor : factors)
+			{
+				for (const BlurEngine engine : { BlurEngine::FLOAT, BlurEngine::INTEGER, BlurEngine::PLANAR })
+				{
+					const char* engine_name = get_engine_name(engine);
+					auto blur_to = [&](const std::string& path, const BlurMode mode, const int threads)
+					{
+						TGA image(in_path, engine);
+						image.blur(factor, threads, mode);
+						image.write(path);
+					};
+
+					blur_to(reference_path, BlurMode::REFERENCE, 1);
+					// The SAT sums exactly like the reference, the float results only differ by the rounding of the doubles
+					blur_to(out_path, BlurMode::SAT, 3);
+					check("sat", size, depth, engine_name, factor, get_max_difference(reference_path, out_path, size, depth),
+						  engine == BlurEngine::INTEGER ? 0 : 1);
+					// The running averages round in float, or twice (once per pass) in the integer engine
+					blur_to(out_path, BlurMode::BOX, 3);
+					check("box", size, depth, engine_name, factor, get_max_difference(reference_path, out_path, size, depth), 1);
+				}
+
+				// Mono images can't be streamed
+				if (depth != 8)
+				{
+					TGA image(in_path);
+					image.blur(factor);
+					image.write(reference_path);
+					TGA::blur_stream(in_path, out_path, factor);
+					check("stream", size, depth, "float", factor, get_max_difference(reference_path, out_path, size, depth), 0);
+				}
+				// Same sums in the same order, the planes only change where they're kept
+				for (const BlurMode mode : { BlurMode::BOX, BlurMode::GAUSSIAN })
+				{
+					TGA image(in_path);
+					image.blur(factor, 1, mode);
+					image.write(reference_path);
+					TGA planar(in_path, BlurEngine::PLANAR);
+					planar.blur(factor, 3, mode);
+					planar.write(out_path);
+					check(mode == BlurMode::BOX ? "planar_box" : "planar_gaussian", size, depth, "planar", factor,
+						  get_max_difference(reference_path, out_path, size, depth), 0);
+				}
+			}
+			std::filesystem::remove(in_path);
+		}
+	}
+
+	// A blurred region is the same region of the whole image blur, with the rest of the image left as it was. Regions
+	// are given as seen on screen, so they're checked in every orientation of the file (the descriptor bits 4 and 5).
+	for (const ImageSize& size : sizes)
+	{
+		const std::vector<BlurRect> rects = { { size.width / 5, size.height / 4, size.width / 2, size.height / 2 },
+											  { 0, size.height / 2, size.width / 3 + 1, size.height - size.height / 2 } };
+		for (const int depth : { 8, 24, 32 })
+		{
+			const std::string in_path = get_image_path(options.dir, size, depth, false);
+			generate_tga(in_path, size.width, size.height, depth, false);
+			std::vector<uint8_t> file = read_file(in_path);
+			for (const float factor : factors)
+			{
+				for (const BlurEngine engine : { BlurEngine::FLOAT, BlurEngine::INTEGER, BlurEngine::PLANAR })
+				{
+					int max_difference = 0;
+					for (const uint8_t orientation : { 0x00, 0x10, 0x20, 0x30 })
+					{
+						file[17] = static_cast<uint8_t>((file[17] & 0xCF) | orientation);
+						std::ofstream(in_path, std::ios::binary | std::ios::trunc)
+							.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+						for (const BlurMode mode : { BlurMode::BOX, BlurMode::GAUSSIAN })
+						{
+							TGA image(in_path, engine);
+							image.blur(factor, 1, mode);
+							image.write(reference_path);
+							for (const BlurRect& rect : rects)
+							{
+								TGA region(in_path, engine);
+								region.blur(rect, factor, 3, mode);
+								region.write(out_path);
+
+								// Same rectangle in the order the rows and columns are in the file
+								BlurRect stored_rect = rect;
+								if ((orientation & 0x20) == 0)
+								{
+									stored_rect.y = size.height - rect.y - rect.height;
+								}
+								if ((orientation & 0x10) != 0)
+								{
+									stored_rect.x = size.width - rect.x - rect.width;
+								}
+								max_difference = std::max(max_difference, get_max_roi_difference(in_path, reference_path,
+																								  out_path, size, depth, stored_rect));
+							}
+						}
+					}
+					// Bit for bit with integer sums, up to the float rounding otherwise
+					check("roi", size, depth, get_engine_name(engine), factor, max_difference,
+						  engine == BlurEngine::INTEGER || depth == 8 ? 0 : 1);
+				}
+			}
+			std::filesystem::remove(in_path);
+		}
+	}
+
+	// Incremental blurs brought up to date after edits (a few rows, a few columns, a rectangle) against fresh blurs of
+	// the edited image. The edits paste the pixels of another image.
+	for (const ImageSize& size : sizes)
+	{
+		const std::vector<BlurRect> edits = { { 0, size.height / 3, size.width, 2 },
+											  { size.width / 2, 0, std::min(3, size.width - size.width / 2), size.height },
+											  { size.width / 4, size.height / 4, size.width / 3 + 1, size.height / 5 + 1 } };
+		for (const int depth : { 8, 24, 32 })
+		{
+			const std::string in_path = get_image_path(options.dir, size, depth, false);
+			generate_tga(in_path, size.width, size.height, depth, false);
+			generate_tga(reference_path, size.width, size.height, depth, false, get_worst_case_rle_pixel);
+			for (const float factor : factors)
+			{
+				for (const BlurEngine engine : { BlurEngine::FLOAT, BlurEngine::INTEGER, BlurEngine::PLANAR })
+				{
+					TGA source(in_path, engine);
+					TGA target(in_path, engine);
+					TGA fresh(in_path, engine);
+					const TGA brush(reference_path, engine);
+					const bool is_float = (engine != BlurEngine::INTEGER && depth != 8);
+
+					IncrementalBlur blur(source.get_view(), target.get_view(), factor, 3);
+					int max_difference = 0;
+					for (const BlurRect& edit : edits)
+					{
+						copy_region(brush.get_view(), source.get_view(), edit);
+						blur.update(edit);
+
+						copy_region(source.get_view(), fresh.get_view(), { 0, 0, size.width, size.height });
+						fresh.blur(factor);
+						const int difference = (is_float ? get_max_float_difference(target.get_view(), fresh.get_view()) :
+															   get_max_difference(target.get_view(), fresh.get_view()));
+						max_difference = std::max(max_difference, difference);
+					}
+					// Bit for bit with integer sums, float ones restart at the edge of the update (the difference is
+					// in millionths then)
+					check("incremental", size, depth, get_engine_name(engine), factor, max_difference, is_float ? 10 : 0);
+				}
+			}
+			std::filesystem::remove(in_path);
+		}
+	}
+
+	// Every target of a multiple factor blur is the single factor blur of the source, which stays as it was
+	for (const ImageSize& size : sizes)
+	{
+		for (const int depth : { 8, 24, 32 })
+		{
+			const std::string in_path = get_image_path(options.dir, size, depth, false);
+			generate_tga(in_path, size.width, size.height, depth, false);
+			for (const BlurEngine engine : { BlurEngine::FLOAT, BlurEngine::INTEGER, BlurEngine::PLANAR })
+			{
+				for (const BlurMode mode : { BlurMode::BOX, BlurMode::SAT, BlurMode::GAUSSIAN, BlurMode::APPROXIMATE })
+				{
+					const TGA original(in_path, engine);
+					const TGA source(in_path, engine);
+					std::vector<std::unique_ptr<TGA>> outputs;
+					std::vector<ImageView> targets;
+					for (size_t k = 0; k < factors.size(); k++)
+					{
+						outputs.push_back(std::make_unique<TGA>(in_path, engine));
+						targets.push_back(outputs.back()->get_view());
+					}
+					blur_image_multi(source.get_view(), targets, factors, 3, mode);
+
+					int max_difference = get_max_difference(original.get_view(), source.get_view());
+					for (size_t k = 0; k < factors.size(); k++)
+					{
+						TGA single(in_path, engine);
+						blur_image(single.get_view(), factors[k], 1, mode);
+						max_difference = std::max(max_difference, get_max_difference(single.get_view(), targets[k]));
+					}
+					const char* mode_name = (mode == BlurMode::BOX ? "multi_box" : mode == BlurMode::SAT ? "multi_sat" :
+											 mode == BlurMode::GAUSSIAN ? "multi_gaussian" : "multi_approx");
+					// Reported with the largest factor, they're all checked
+					check(mode_name, size, depth, get_engine_name(engine), factors.back(), max_difference, 0);
+				}
+			}
+			std::filesystem::remove(in_path);
+		}
+	}
+
+	// Run-length encoded outputs decode to the pixels of the uncompressed ones, worst case rows included (they take the
+	// largest size the output is laid out for), and parse back
+	for (const ImageSize& size : { ImageSize{ 90, 70 }, ImageSize{ 300, 6 }, ImageSize{ 2, 3 } })
+	{
+		for (const int depth : { 8, 24, 32 })
+		{
+			const std::string in_path = get_image_path(options.dir, size, depth, false);
+			const std::string rle_path = get_image_path(options.dir, size, depth, true);
+			generate_tga(in_path, size.width, size.height, depth, false, get_worst_case_rle_pixel);
+			generate_tga(rle_path, size.width, size.height, depth, true, get_worst_case_rle_pixel);
+			for (const float factor : { 0.f, 0.3f })
+			{
+				int max_difference = 256;
+				try
+				{
+					TGA image(in_path);
+					image.blur(factor);
+					image.write(reference_path);
+					TGA rle_image(rle_path);
+					rle_image.blur(factor);
+					rle_image.write(out_path);
+					TGA written(out_path);
+					max_difference = get_max_rle_difference(reference_path, out_path, size, depth);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "rle_roundtrip: " << e.what() << std::endl;
+				}
+				check("rle_roundtrip", size, depth, "float", factor, max_difference, 0);
+			}
+			std::filesystem::remove(in_path);
+			std::filesystem::remove(rle_path);
+		}
+	}
+
+	// The approximate mode only kicks in once the kernel is large enough, so it's checked on larger images
+	const ImageSize approximate_size = { 1024, 768 };
+	const double min_psnr = 40.0;
+	std::cout << "verify,check,size,depth,engine,factor,psnr_db,result" << std::endl;
+	for (const int depth : { 8, 24, 32 })
+	{
+		const std::string in_path = get_image_path(options.dir, approximate_size, depth, false);
+		generate_tga(in_path, approximate_size.width, approximate_size.height, depth, false);
+		for (const float factor : { 0.5f, 1.f })
+		{
+			for (const BlurEngine engine : { BlurEngine::FLOAT, BlurEngine::INTEGER, BlurEngine::PLANAR })
+			{
+				TGA exact(in_path, engine);
+				exact.blur(factor, 1, BlurMode::BOX);
+				exact.write(reference_path);
+				TGA approximate(in_path, engine);
+				approximate.blur(factor, 3, BlurMode::APPROXIMATE);
+				approximate.write(out_path);
+
+				const double psnr = get_psnr(reference_path, out_path, approximate_size, depth);
+				const bool passed = psnr >= min_psnr;
+				ok = ok && passed;
+				char line[200];
+				snprintf(line, sizeof(line), "verify,approx,%dx%d,%d,%s,%.2f,%.2f,%s", approximate_size.width,
+						 approximate_size.height, depth, get_engine_name(engine), factor, psnr, passed ? "ok" : "FAIL");
+				std::cout << line << std::endl;
+			}
+		}
+		std::filesystem::remove(in_path);
+	}
+
+	std::filesystem::remove(reference_path);
+	std::filesystem::remove(out_path);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		std::vector<std::string> args(argv + 1, argv + argc);
+		BenchmarkOptions options;
+
+		for (std::size_t i = 0; i < args.size(); i++)
+		{
+			if (args[i] == "--rle")
+			{
+				options.rle = true;
+			}
+			else if (args[i] == "--verify")
+			{
+				options.verify = true;
+			}
+			else if (i + 1 >= args.size())
+			{
+				char buffer[100];
+				snprintf(buffer, sizeof(buffer), "Error: Option %s is unknown or is missing its value", args[i].c_str());
+				throw std::invalid_argument(buffer);
+			}
+			else if (args[i] == "--sizes")
+			{
+				options.sizes.clear();
+				for (const std::string& item : split(args[++i]))
+				{
+					ImageSize size = {};
+					if (sscanf(item.c_str(), "%dx%d", &size.width, &size.height) != 2 || size.width < 1 || size.height < 1 ||
+						size.width > 65535 || size.height > 65535)
+					{
+						char buffer[100];
+						snprintf(buffer, sizeof(buffer), "Error: Invalid size %s (WIDTHxHEIGHT)", item.c_str());
+						throw std::invalid_argument(buffer);
+					}
+					options.sizes.push_back(size);
+				}
+			}
+			else if (args[i] == "--depths")
+			{
+				options.depths.clear();
+				for (const std::string& item : split(args[++i]))
+				{
+					const int depth = std::stoi(item);
+					if (depth != 8 && depth != 24 && depth != 32)
+					{
+						throw std::invalid_argument("Error: Depths can only be 8 (mono), 24 or 32");
+					}
+					options.depths.push_back(depth);
+				}
+			}
+			else if (args[i] == "--factors")
+			{
+				options.factors.clear();
+				for (const std::string& item : split(args[++i]))
+				{
+					options.factors.push_back(std::stof(item));
+				}
+			}
+			else if (args[i] == "--engine")
+			{
+				const std::string name = args[++i];
+				if (name != "float" && name != "int" && name != "planar")
+				{
+					throw std::invalid_argument("Error: Unknown engine (float, int, planar)");
+				}
+				options.engine = (name == "int" ? BlurEngine::INTEGER : name == "planar" ? BlurEngine::PLANAR : BlurEngine::FLOAT);
+			}
+			else if (args[i] == "--mode")
+			{
+				options.mode_name = args[++i];
+				if (options.mode_name == "box")
+				{
+					options.mode = BlurMode::BOX;
+				}
+				else if (options.mode_name == "sat")
+				{
+					options.mode = BlurMode::SAT;
+				}
+				else if (options.mode_name == "gaussian")
+				{
+					options.mode = BlurMode::GAUSSIAN;
+				}
+				else if (options.mode_name == "approx")
+				{
+					options.mode = BlurMode::APPROXIMATE;
+				}
+				else
+				{
+					throw std::invalid_argument("Error: Unknown mode (box, sat, gaussian, approx)");
+				}
+			}
+			else if (args[i] == "--tolerance")
+			{
+				options.tolerance = std::stof(args[++i]);
+			}
+			else if (args[i] == "-j")
+			{
+				options.threads = std::max(1, std::stoi(args[++i]));
+			}
+			else if (args[i] == "--isa")
+			{
+				set_blur_isa(parse_blur_isa(args[++i]));
+			}
+			else if (args[i] == "--repeat")
+			{
+				options.repeat = std::max(1, std::stoi(args[++i]));
+			}
+			else if (args[i] == "--dir")
+			{
+				options.dir = args[++i];
+			}
+			else
+			{
+				char buffer[100];
+				snprintf(buffer, sizeof(buffer), "Error: Unknown option %s", args[i].c_str());
+				throw std::invalid_argument(buffer);
+			}
+		}
+
+		if (options.dir.empty())
+		{
+			options.dir = std::filesystem::temp_directory_path().string();
+		}
+		std::filesystem::create_directories(options.dir);
+
+		if (options.verify)
+		{
+			return run_verify(options) ? 0 : 1;
+		}
+		run_benchmark(options);
+		return 0;
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "Caught: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,1378 @@
+#include "BlurKernels.h"
+#include <algorithm>
+#include <stdexcept>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BLUR_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC lets any intrinsic through, GCC and Clang need the instruction set enabled per function
+#if defined(_MSC_VER)
+#define BLUR_TARGET(isa)
+#else
+#define BLUR_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// The vector kernels load a whole pixel at once, so RGBA must be 4 packed floats
+static_assert(sizeof(RGBA) == 4 * sizeof(float), "RGBA is expected to be 4 tightly packed floats");
+
+// The vertical passes don't walk one column at a time (every step would jump a whole row and miss the cache),
+// they keep a row of sums for a block of columns and slide it down. 256 float RGBA sums take 4KB, so the sums
+// and the three rows streamed at each step (entering, leaving and output) fit comfortably in L1.
+static const int COLUMN_BLOCK = 256;
+
+
+static void blur_rows_scalar(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+							 const int rows, const int width, const int kernel_size)
+{
+	for (int i = 0; i < rows; i++) // Row index
+	{
+		const RGBA* in = src + i * src_stride;
+		RGBA* out = dst + i * dst_stride;
+
+		// Initialize sum and fill the buffer for the first time before using the moving average
+		RGBA sum = RGBA(0.f, 1.f);
+		int k = 0;
+		while (k < kernel_size)
+		{
+			sum += in[k];
+			k++;
+		}
+		out[0] = sum / RGBA(kernel_size, 1.f);
+
+		for (int j = 1; j < width; j++, k++) // Col index
+		{
+			// Moving average
+			sum += in[k];
+			sum -= in[k - kernel_size];
+			out[j] = sum / RGBA(kernel_size, 1.f);
+		}
+	}
+}
+
+static void blur_cols_scalar(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+							 const int cols, const int height, const int kernel_size)
+{
+	RGBA sums[COLUMN_BLOCK];
+	for (int block = 0; block < cols; block += COLUMN_BLOCK)
+	{
+		const int count = std::min(COLUMN_BLOCK, cols - block);
+		const RGBA* top = src + block;
+		RGBA* out = dst + block;
+
+		// Initialize a whole row of sums with the first window of rows, one row at a time
+		for (int c = 0; c < count; c++)
+		{
+			sums[c] = RGBA(0.f, 1.f);
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const RGBA* in = top + k * src_stride;
+			for (int c = 0; c < count; c++)
+			{
+				sums[c] += in[c];
+			}
+		}
+		for (int c = 0; c < count; c++)
+		{
+			out[c] = sums[c] / RGBA(kernel_size, 1.f);
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			// Moving average, sliding the whole row of sums down by one row
+			const RGBA* in = top + (j - 1 + kernel_size) * src_stride;
+			const RGBA* leaving = top + (j - 1) * src_stride;
+			RGBA* row = out + j * dst_stride;
+			for (int c = 0; c < count; c++)
+			{
+				sums[c] += in[c];
+				sums[c] -= leaving[c];
+				row[c] = sums[c] / RGBA(kernel_size, 1.f);
+			}
+		}
+	}
+}
+
+// Single channel passes over the planes of planar images (see PixelLayout). Every value goes through the same
+// add/subtract/divide sequence of the RGBA kernels, so both layouts blur to the same numbers. The column block
+// takes as many bytes of sums as the RGBA one.
+static const int PLANE_COLUMN_BLOCK = 4 * COLUMN_BLOCK;
+
+static void blur_plane_rows_scalar(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+								   const int rows, const int width, const int kernel_size)
+{
+	const float divisor = static_cast<float>(kernel_size);
+	for (int i = 0; i < rows; i++) // Row index
+	{
+		const float* in = src + i * src_stride;
+		float* out = dst + i * dst_stride;
+
+		float sum = 0.f;
+		int k = 0;
+		for (; k < kernel_size; k++)
+		{
+			sum += in[k];
+		}
+		out[0] = sum / divisor;
+
+		for (int j = 1; j < width; j++, k++) // Col index
+		{
+			sum += in[k];
+			sum -= in[k - kernel_size];
+			out[j] = sum / divisor;
+		}
+	}
+}
+
+static void blur_plane_cols_scalar(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+								   const int cols, const int height, const int kernel_size)
+{
+	const float divisor = static_cast<float>(kernel_size);
+	float sums[PLANE_COLUMN_BLOCK];
+	for (int block = 0; block < cols; block += PLANE_COLUMN_BLOCK)
+	{
+		const int count = std::min(PLANE_COLUMN_BLOCK, cols - block);
+		const float* top = src + block;
+		float* out = dst + block;
+
+		std::fill(sums, sums + count, 0.f);
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * src_stride;
+			for (int c = 0; c < count; c++)
+			{
+				sums[c] += in[c];
+			}
+		}
+		for (int c = 0; c < count; c++)
+		{
+			out[c] = sums[c] / divisor;
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * src_stride;
+			const float* leaving = top + (j - 1) * src_stride;
+			float* row = out + j * dst_stride;
+			for (int c = 0; c < count; c++)
+			{
+				sums[c] += in[c];
+				sums[c] -= leaving[c];
+				row[c] = sums[c] / divisor;
+			}
+		}
+	}
+}
+
+// 8-bit BGR(A) pixels to float RGBA and back. Decoding divides by 255 like the vector kernels do (a division is
+// correctly rounded on any of them), encoding clamps to [0, 1] and rounds to the nearest value, half to even,
+// which is what the vector float to int conversions do with the default rounding mode.
+template <int BytesPerPixel>
+static void decode_bgr_scalar(const uint8_t* src, RGBA* dst, const size_t count)
+{
+	for (size_t j = 0; j < count; j++, src += BytesPerPixel)
+	{
+		dst[j].red = static_cast<int>(src[2]) / 255.f;
+		dst[j].green = static_cast<int>(src[1]) / 255.f;
+		dst[j].blue = static_cast<int>(src[0]) / 255.f;
+		dst[j].alpha = (BytesPerPixel == 4 ? static_cast<int>(src[3]) / 255.f : 1.f);
+	}
+}
+
+// Adding 2^23 leaves no fraction bits, so the sum is rounded (half to even) by the addition itself: the same as
+// lrint() without the library call, exact for anything between 0 and 255
+static inline uint8_t encode_channel(const float value)
+{
+	const float rounder = 8388608.f;
+	const float scaled = std::min(1.f, std::max(0.f, value)) * 255.f;
+	return static_cast<uint8_t>(static_cast<int>((scaled + rounder) - rounder));
+}
+
+template <int BytesPerPixel>
+static void encode_bgr_scalar(const RGBA* src, uint8_t* dst, const size_t count)
+{
+	for (size_t j = 0; j < count; j++, dst += BytesPerPixel)
+	{
+		dst[0] = encode_channel(src[j].blue);
+		dst[1] = encode_channel(src[j].green);
+		dst[2] = encode_channel(src[j].red);
+		if (BytesPerPixel == 4)
+		{
+			dst[3] = encode_channel(src[j].alpha);
+		}
+	}
+}
+
+// Same conversions for planar images, planes[0 ... 2] are the red, green and blue planes and planes[3] the alpha one
+// (left alone by 24 bit pixels)
+template <int BytesPerPixel>
+static void decode_bgr_planes_scalar(const uint8_t* src, float* const* planes, const size_t count)
+{
+	for (size_t j = 0; j < count; j++, src += BytesPerPixel)
+	{
+		planes[0][j] = static_cast<int>(src[2]) / 255.f;
+		planes[1][j] = static_cast<int>(src[1]) / 255.f;
+		planes[2][j] = static_cast<int>(src[0]) / 255.f;
+		if (BytesPerPixel == 4)
+		{
+			planes[3][j] = static_cast<int>(src[3]) / 255.f;
+		}
+	}
+}
+
+template <int BytesPerPixel>
+static void encode_bgr_planes_scalar(const float* const* planes, uint8_t* dst, const size_t count)
+{
+	for (size_t j = 0; j < count; j++, dst += BytesPerPixel)
+	{
+		dst[0] = encode_channel(planes[2][j]);
+		dst[1] = encode_channel(planes[1][j]);
+		dst[2] = encode_channel(planes[0][j]);
+		if (BytesPerPixel == 4)
+		{
+			dst[3] = encode_channel(planes[3][j]);
+		}
+	}
+}
+
+static void decode_bgr_scalar(const uint8_t* src, RGBA* dst, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? decode_bgr_scalar<4>(src, dst, count) : decode_bgr_scalar<3>(src, dst, count);
+}
+
+static void encode_bgr_scalar(const RGBA* src, uint8_t* dst, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? encode_bgr_scalar<4>(src, dst, count) : encode_bgr_scalar<3>(src, dst, count);
+}
+
+static void decode_bgr_planes_scalar(const uint8_t* src, float* const* planes, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? decode_bgr_planes_scalar<4>(src, planes, count) : decode_bgr_planes_scalar<3>(src, planes, count);
+}
+
+static void encode_bgr_planes_scalar(const float* const* planes, uint8_t* dst, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? encode_bgr_planes_scalar<4>(planes, dst, count) : encode_bgr_planes_scalar<3>(planes, dst, count);
+}
+
+#if defined(BLUR_X86)
+
+// The vector kernels follow exactly the same add/subtract/divide sequence of the scalar ones (just on more
+// lanes), which is what keeps them bit-identical. The alpha lane is accumulated too, but it's overwritten
+// with 1 on store because RGBA arithmetic never touches alpha. The row kernels carry two independent
+// accumulators at once to hide the latency of the running sum dependency chain, the column kernels sweep
+// a whole block of sums down the image so that every load is contiguous.
+
+// SSE4.1: one pixel per register, two rows per iteration
+BLUR_TARGET("sse4.1")
+static void blur_rows_sse41(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+							const int rows, const int width, const int kernel_size)
+{
+	const __m128 divisor = _mm_set1_ps(static_cast<float>(kernel_size));
+	const __m128 one = _mm_set1_ps(1.f);
+	int i = 0;
+	for (; i + 2 <= rows; i += 2)
+	{
+		const float* in0 = reinterpret_cast<const float*>(src + i * src_stride);
+		const float* in1 = in0 + 4 * src_stride;
+		float* out0 = reinterpret_cast<float*>(dst + i * dst_stride);
+		float* out1 = out0 + 4 * dst_stride;
+
+		__m128 sum0 = _mm_setzero_ps();
+		__m128 sum1 = _mm_setzero_ps();
+		int k = 0;
+		for (; k < kernel_size; k++)
+		{
+			sum0 = _mm_add_ps(sum0, _mm_loadu_ps(in0 + 4 * k));
+			sum1 = _mm_add_ps(sum1, _mm_loadu_ps(in1 + 4 * k));
+		}
+		_mm_storeu_ps(out0, _mm_blend_ps(_mm_div_ps(sum0, divisor), one, 0x8));
+		_mm_storeu_ps(out1, _mm_blend_ps(_mm_div_ps(sum1, divisor), one, 0x8));
+
+		for (int j = 1; j < width; j++, k++)
+		{
+			sum0 = _mm_sub_ps(_mm_add_ps(sum0, _mm_loadu_ps(in0 + 4 * k)), _mm_loadu_ps(in0 + 4 * (k - kernel_size)));
+			sum1 = _mm_sub_ps(_mm_add_ps(sum1, _mm_loadu_ps(in1 + 4 * k)), _mm_loadu_ps(in1 + 4 * (k - kernel_size)));
+			_mm_storeu_ps(out0 + 4 * j, _mm_blend_ps(_mm_div_ps(sum0, divisor), one, 0x8));
+			_mm_storeu_ps(out1 + 4 * j, _mm_blend_ps(_mm_div_ps(sum1, divisor), one, 0x8));
+		}
+	}
+	blur_rows_scalar(src + i * src_stride, src_stride, dst + i * dst_stride, dst_stride, rows - i, width, kernel_size);
+}
+
+BLUR_TARGET("sse4.1")
+static void blur_cols_sse41(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+							const int cols, const int height, const int kernel_size)
+{
+	const ptrdiff_t in_stride = 4 * src_stride;
+	const ptrdiff_t out_stride = 4 * dst_stride;
+	const __m128 divisor = _mm_set1_ps(static_cast<float>(kernel_size));
+	const __m128 one = _mm_set1_ps(1.f);
+	alignas(64) float sums[4 * COLUMN_BLOCK];
+	for (int block = 0; block < cols; block += COLUMN_BLOCK)
+	{
+		const int floats = 4 * std::min(COLUMN_BLOCK, cols - block);
+		const float* top = reinterpret_cast<const float*>(src + block);
+		float* out = reinterpret_cast<float*>(dst + block);
+
+		for (int c = 0; c < floats; c += 4)
+		{
+			_mm_store_ps(sums + c, _mm_setzero_ps());
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * in_stride;
+			for (int c = 0; c < floats; c += 4)
+			{
+				_mm_store_ps(sums + c, _mm_add_ps(_mm_load_ps(sums + c), _mm_loadu_ps(in + c)));
+			}
+		}
+		for (int c = 0; c < floats; c += 4)
+		{
+			_mm_storeu_ps(out + c, _mm_blend_ps(_mm_div_ps(_mm_load_ps(sums + c), divisor), one, 0x8));
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * in_stride;
+			const float* leaving = top + (j - 1) * in_stride;
+			float* row = out + j * out_stride;
+			for (int c = 0; c < floats; c += 4)
+			{
+				const __m128 sum = _mm_sub_ps(_mm_add_ps(_mm_load_ps(sums + c), _mm_loadu_ps(in + c)), _mm_loadu_ps(leaving + c));
+				_mm_store_ps(sums + c, sum);
+				_mm_storeu_ps(row + c, _mm_blend_ps(_mm_div_ps(sum, divisor), one, 0x8));
+			}
+		}
+	}
+}
+
+// AVX2: two pixels per register (either two rows side by side or two adjacent columns)
+BLUR_TARGET("avx2")
+static inline __m256 load_2_rows(const float* row0, const float* row1)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(row0)), _mm_loadu_ps(row1), 1);
+}
+
+BLUR_TARGET("avx2")
+static inline void store_2_rows(float* row0, float* row1, const __m256 value)
+{
+	_mm_storeu_ps(row0, _mm256_castps256_ps128(value));
+	_mm_storeu_ps(row1, _mm256_extractf128_ps(value, 1));
+}
+
+BLUR_TARGET("avx2")
+static void blur_rows_avx2(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+						   const int rows, const int width, const int kernel_size)
+{
+	const ptrdiff_t in_stride = 4 * src_stride;
+	const ptrdiff_t out_stride = 4 * dst_stride;
+	const __m256 divisor = _mm256_set1_ps(static_cast<float>(kernel_size));
+	const __m256 one = _mm256_set1_ps(1.f);
+	int i = 0;
+	for (; i + 4 <= rows; i += 4)
+	{
+		const float* in = reinterpret_cast<const float*>(src + i * src_stride);
+		float* out = reinterpret_cast<float*>(dst + i * dst_stride);
+
+		__m256 sum0 = _mm256_setzero_ps(); // Rows i, i + 1
+		__m256 sum1 = _mm256_setzero_ps(); // Rows i + 2, i + 3
+		int k = 0;
+		for (; k < kernel_size; k++)
+		{
+			sum0 = _mm256_add_ps(sum0, load_2_rows(in + 4 * k, in + in_stride + 4 * k));
+			sum1 = _mm256_add_ps(sum1, load_2_rows(in + 2 * in_stride + 4 * k, in + 3 * in_stride + 4 * k));
+		}
+		store_2_rows(out, out + out_stride, _mm256_blend_ps(_mm256_div_ps(sum0, divisor), one, 0x88));
+		store_2_rows(out + 2 * out_stride, out + 3 * out_stride, _mm256_blend_ps(_mm256_div_ps(sum1, divisor), one, 0x88));
+
+		for (int j = 1; j < width; j++, k++)
+		{
+			const ptrdiff_t entering = 4 * static_cast<ptrdiff_t>(k);
+			const ptrdiff_t leaving = 4 * static_cast<ptrdiff_t>(k - kernel_size);
+			sum0 = _mm256_sub_ps(_mm256_add_ps(sum0, load_2_rows(in + entering, in + in_stride + entering)),
+								 load_2_rows(in + leaving, in + in_stride + leaving));
+			sum1 = _mm256_sub_ps(_mm256_add_ps(sum1, load_2_rows(in + 2 * in_stride + entering, in + 3 * in_stride + entering)),
+								 load_2_rows(in + 2 * in_stride + leaving, in + 3 * in_stride + leaving));
+			store_2_rows(out + 4 * j, out + out_stride + 4 * j, _mm256_blend_ps(_mm256_div_ps(sum0, divisor), one, 0x88));
+			store_2_rows(out + 2 * out_stride + 4 * j, out + 3 * out_stride + 4 * j, _mm256_blend_ps(_mm256_div_ps(sum1, divisor), one, 0x88));
+		}
+	}
+	blur_rows_sse41(src + i * src_stride, src_stride, dst + i * dst_stride, dst_stride, rows - i, width, kernel_size);
+}
+
+BLUR_TARGET("avx2")
+static void blur_cols_avx2(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+						   const int cols, const int height, const int kernel_size)
+{
+	const ptrdiff_t in_stride = 4 * src_stride;
+	const ptrdiff_t out_stride = 4 * dst_stride;
+	const __m256 divisor = _mm256_set1_ps(static_cast<float>(kernel_size));
+	const __m256 one = _mm256_set1_ps(1.f);
+	// Whole vectors only, the leftover column goes to the narrower kernel
+	const int vector_cols = cols / 2 * 2;
+	alignas(64) float sums[4 * COLUMN_BLOCK];
+	for (int block = 0; block < vector_cols; block += COLUMN_BLOCK)
+	{
+		const int floats = 4 * std::min(COLUMN_BLOCK, vector_cols - block);
+		const float* top = reinterpret_cast<const float*>(src + block);
+		float* out = reinterpret_cast<float*>(dst + block);
+
+		for (int c = 0; c < floats; c += 8)
+		{
+			_mm256_store_ps(sums + c, _mm256_setzero_ps());
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * in_stride;
+			for (int c = 0; c < floats; c += 8)
+			{
+				_mm256_store_ps(sums + c, _mm256_add_ps(_mm256_load_ps(sums + c), _mm256_loadu_ps(in + c)));
+			}
+		}
+		for (int c = 0; c < floats; c += 8)
+		{
+			_mm256_storeu_ps(out + c, _mm256_blend_ps(_mm256_div_ps(_mm256_load_ps(sums + c), divisor), one, 0x88));
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * in_stride;
+			const float* leaving = top + (j - 1) * in_stride;
+			float* row = out + j * out_stride;
+			for (int c = 0; c < floats; c += 8)
+			{
+				const __m256 sum = _mm256_sub_ps(_mm256_add_ps(_mm256_load_ps(sums + c), _mm256_loadu_ps(in + c)), _mm256_loadu_ps(leaving + c));
+				_mm256_store_ps(sums + c, sum);
+				_mm256_storeu_ps(row + c, _mm256_blend_ps(_mm256_div_ps(sum, divisor), one, 0x88));
+			}
+		}
+	}
+	blur_cols_sse41(src + vector_cols, src_stride, dst + vector_cols, dst_stride, cols - vector_cols, height, kernel_size);
+}
+
+// GCC 12 headers trip -Wmaybe-uninitialized on the _mm_undefined_ps() used by the 128-bit lane casts
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// AVX-512: four pixels per register (four rows side by side or four adjacent columns)
+BLUR_TARGET("avx512f")
+static inline __m512 load_4_rows(const float* row, const ptrdiff_t stride)
+{
+	__m512 value = _mm512_castps128_ps512(_mm_loadu_ps(row));
+	value = _mm512_insertf32x4(value, _mm_loadu_ps(row + stride), 1);
+	value = _mm512_insertf32x4(value, _mm_loadu_ps(row + 2 * stride), 2);
+	return _mm512_insertf32x4(value, _mm_loadu_ps(row + 3 * stride), 3);
+}
+
+BLUR_TARGET("avx512f")
+static inline void store_4_rows(float* row, const ptrdiff_t stride, const __m512 value)
+{
+	_mm_storeu_ps(row, _mm512_castps512_ps128(value));
+	_mm_storeu_ps(row + stride, _mm512_extractf32x4_ps(value, 1));
+	_mm_storeu_ps(row + 2 * stride, _mm512_extractf32x4_ps(value, 2));
+	_mm_storeu_ps(row + 3 * stride, _mm512_extractf32x4_ps(value, 3));
+}
+
+BLUR_TARGET("avx512f")
+static void blur_rows_avx512(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+							 const int rows, const int width, const int kernel_size)
+{
+	const ptrdiff_t in_stride = 4 * src_stride;
+	const ptrdiff_t out_stride = 4 * dst_stride;
+	const __m512 divisor = _mm512_set1_ps(static_cast<float>(kernel_size));
+	const __m512 one = _mm512_set1_ps(1.f);
+	const __mmask16 alpha = 0x8888;
+	int i = 0;
+	for (; i + 8 <= rows; i += 8)
+	{
+		const float* in0 = reinterpret_cast<const float*>(src + i * src_stride);
+		const float* in1 = in0 + 4 * in_stride;
+		float* out0 = reinterpret_cast<float*>(dst + i * dst_stride);
+		float* out1 = out0 + 4 * out_stride;
+
+		__m512 sum0 = _mm512_setzero_ps(); // Rows i .. i + 3
+		__m512 sum1 = _mm512_setzero_ps(); // Rows i + 4 .. i + 7
+		int k = 0;
+		for (; k < kernel_size; k++)
+		{
+			sum0 = _mm512_add_ps(sum0, load_4_rows(in0 + 4 * k, in_stride));
+			sum1 = _mm512_add_ps(sum1, load_4_rows(in1 + 4 * k, in_stride));
+		}
+		store_4_rows(out0, out_stride, _mm512_mask_mov_ps(_mm512_div_ps(sum0, divisor), alpha, one));
+		store_4_rows(out1, out_stride, _mm512_mask_mov_ps(_mm512_div_ps(sum1, divisor), alpha, one));
+
+		for (int j = 1; j < width; j++, k++)
+		{
+			const ptrdiff_t entering = 4 * static_cast<ptrdiff_t>(k);
+			const ptrdiff_t leaving = 4 * static_cast<ptrdiff_t>(k - kernel_size);
+			sum0 = _mm512_sub_ps(_mm512_add_ps(sum0, load_4_rows(in0 + entering, in_stride)), load_4_rows(in0 + leaving, in_stride));
+			sum1 = _mm512_sub_ps(_mm512_add_ps(sum1, load_4_rows(in1 + entering, in_stride)), load_4_rows(in1 + leaving, in_stride));
+			store_4_rows(out0 + 4 * j, out_stride, _mm512_mask_mov_ps(_mm512_div_ps(sum0, divisor), alpha, one));
+			store_4_rows(out1 + 4 * j, out_stride, _mm512_mask_mov_ps(_mm512_div_ps(sum1, divisor), alpha, one));
+		}
+	}
+	blur_rows_avx2(src + i * src_stride, src_stride, dst + i * dst_stride, dst_stride, rows - i, width, kernel_size);
+}
+
+BLUR_TARGET("avx512f")
+static void blur_cols_avx512(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+							 const int cols, const int height, const int kernel_size)
+{
+	const ptrdiff_t in_stride = 4 * src_stride;
+	const ptrdiff_t out_stride = 4 * dst_stride;
+	const __m512 divisor = _mm512_set1_ps(static_cast<float>(kernel_size));
+	const __m512 one = _mm512_set1_ps(1.f);
+	const __mmask16 alpha = 0x8888;
+	// Whole vectors only, the leftover columns go to the narrower kernel
+	const int vector_cols = cols / 4 * 4;
+	alignas(64) float sums[4 * COLUMN_BLOCK];
+	for (int block = 0; block < vector_cols; block += COLUMN_BLOCK)
+	{
+		const int floats = 4 * std::min(COLUMN_BLOCK, vector_cols - block);
+		const float* top = reinterpret_cast<const float*>(src + block);
+		float* out = reinterpret_cast<float*>(dst + block);
+
+		for (int c = 0; c < floats; c += 16)
+		{
+			_mm512_store_ps(sums + c, _mm512_setzero_ps());
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * in_stride;
+			for (int c = 0; c < floats; c += 16)
+			{
+				_mm512_store_ps(sums + c, _mm512_add_ps(_mm512_load_ps(sums + c), _mm512_loadu_ps(in + c)));
+			}
+		}
+		for (int c = 0; c < floats; c += 16)
+		{
+			_mm512_storeu_ps(out + c, _mm512_mask_mov_ps(_mm512_div_ps(_mm512_load_ps(sums + c), divisor), alpha, one));
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * in_stride;
+			const float* leaving = top + (j - 1) * in_stride;
+			float* row = out + j * out_stride;
+			for (int c = 0; c < floats; c += 16)
+			{
+				const __m512 sum = _mm512_sub_ps(_mm512_add_ps(_mm512_load_ps(sums + c), _mm512_loadu_ps(in + c)), _mm512_loadu_ps(leaving + c));
+				_mm512_store_ps(sums + c, sum);
+				_mm512_storeu_ps(row + c, _mm512_mask_mov_ps(_mm512_div_ps(sum, divisor), alpha, one));
+			}
+		}
+	}
+	blur_cols_avx2(src + vector_cols, src_stride, dst + vector_cols, dst_stride, cols - vector_cols, height, kernel_size);
+}
+
+// Planar passes. Columns of a plane are contiguous, so the column pass is the RGBA one with a value per lane
+// instead of a pixel. The row pass carries 4 rows in the lanes of a register: blocks of 4 values of each row are
+// loaded and transposed, so that every register holds one position of the 4 rows. The wider instruction sets use
+// the same row kernel, a wider transpose costs more than it saves.
+BLUR_TARGET("sse4.1")
+static void blur_plane_rows_sse41(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+								  const int rows, const int width, const int kernel_size)
+{
+	const __m128 divisor = _mm_set1_ps(static_cast<float>(kernel_size));
+	int i = 0;
+	for (; i + 4 <= rows; i += 4)
+	{
+		const float* in0 = src + i * src_stride;
+		const float* in1 = in0 + src_stride;
+		const float* in2 = in1 + src_stride;
+		const float* in3 = in2 + src_stride;
+		float* out0 = dst + i * dst_stride;
+		float* out1 = out0 + dst_stride;
+		float* out2 = out1 + dst_stride;
+		float* out3 = out2 + dst_stride;
+
+		__m128 sum = _mm_setzero_ps();
+		for (int k = 0; k < kernel_size; k++)
+		{
+			sum = _mm_add_ps(sum, _mm_setr_ps(in0[k], in1[k], in2[k], in3[k]));
+		}
+		alignas(16) float first[4];
+		_mm_store_ps(first, _mm_div_ps(sum, divisor));
+		out0[0] = first[0];
+		out1[0] = first[1];
+		out2[0] = first[2];
+		out3[0] = first[3];
+
+		int j = 1;
+		for (; j + 4 <= width; j += 4)
+		{
+			// Positions j ... j + 3 enter at j + kernel_size - 1 and leave from j - 1
+			const int k = j + kernel_size - 1;
+			__m128 entering0 = _mm_loadu_ps(in0 + k), entering1 = _mm_loadu_ps(in1 + k);
+			__m128 entering2 = _mm_loadu_ps(in2 + k), entering3 = _mm_loadu_ps(in3 + k);
+			_MM_TRANSPOSE4_PS(entering0, entering1, entering2, entering3);
+			__m128 leaving0 = _mm_loadu_ps(in0 + j - 1), leaving1 = _mm_loadu_ps(in1 + j - 1);
+			__m128 leaving2 = _mm_loadu_ps(in2 + j - 1), leaving3 = _mm_loadu_ps(in3 + j - 1);
+			_MM_TRANSPOSE4_PS(leaving0, leaving1, leaving2, leaving3);
+
+			sum = _mm_sub_ps(_mm_add_ps(sum, entering0), leaving0);
+			__m128 result0 = _mm_div_ps(sum, divisor);
+			sum = _mm_sub_ps(_mm_add_ps(sum, entering1), leaving1);
+			__m128 result1 = _mm_div_ps(sum, divisor);
+			sum = _mm_sub_ps(_mm_add_ps(sum, entering2), leaving2);
+			__m128 result2 = _mm_div_ps(sum, divisor);
+			sum = _mm_sub_ps(_mm_add_ps(sum, entering3), leaving3);
+			__m128 result3 = _mm_div_ps(sum, divisor);
+
+			_MM_TRANSPOSE4_PS(result0, result1, result2, result3);
+			_mm_storeu_ps(out0 + j, result0);
+			_mm_storeu_ps(out1 + j, result1);
+			_mm_storeu_ps(out2 + j, result2);
+			_mm_storeu_ps(out3 + j, result3);
+		}
+		for (; j < width; j++)
+		{
+			const int k = j + kernel_size - 1;
+			sum = _mm_sub_ps(_mm_add_ps(sum, _mm_setr_ps(in0[k], in1[k], in2[k], in3[k])),
+							 _mm_setr_ps(in0[j - 1], in1[j - 1], in2[j - 1], in3[j - 1]));
+			alignas(16) float result[4];
+			_mm_store_ps(result, _mm_div_ps(sum, divisor));
+			out0[j] = result[0];
+			out1[j] = result[1];
+			out2[j] = result[2];
+			out3[j] = result[3];
+		}
+	}
+	blur_plane_rows_scalar(src + i * src_stride, src_stride, dst + i * dst_stride, dst_stride, rows - i, width, kernel_size);
+}
+
+BLUR_TARGET("sse4.1")
+static void blur_plane_cols_sse41(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+								  const int cols, const int height, const int kernel_size)
+{
+	const __m128 divisor = _mm_set1_ps(static_cast<float>(kernel_size));
+	const int vector_cols = cols / 4 * 4;
+	alignas(64) float sums[PLANE_COLUMN_BLOCK];
+	for (int block = 0; block < vector_cols; block += PLANE_COLUMN_BLOCK)
+	{
+		const int count = std::min(PLANE_COLUMN_BLOCK, vector_cols - block);
+		const float* top = src + block;
+		float* out = dst + block;
+
+		for (int c = 0; c < count; c += 4)
+		{
+			_mm_store_ps(sums + c, _mm_setzero_ps());
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * src_stride;
+			for (int c = 0; c < count; c += 4)
+			{
+				_mm_store_ps(sums + c, _mm_add_ps(_mm_load_ps(sums + c), _mm_loadu_ps(in + c)));
+			}
+		}
+		for (int c = 0; c < count; c += 4)
+		{
+			_mm_storeu_ps(out + c, _mm_div_ps(_mm_load_ps(sums + c), divisor));
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * src_stride;
+			const float* leaving = top + (j - 1) * src_stride;
+			float* row = out + j * dst_stride;
+			for (int c = 0; c < count; c += 4)
+			{
+				const __m128 sum = _mm_sub_ps(_mm_add_ps(_mm_load_ps(sums + c), _mm_loadu_ps(in + c)), _mm_loadu_ps(leaving + c));
+				_mm_store_ps(sums + c, sum);
+				_mm_storeu_ps(row + c, _mm_div_ps(sum, divisor));
+			}
+		}
+	}
+	blur_plane_cols_scalar(src + vector_cols, src_stride, dst + vector_cols, dst_stride, cols - vector_cols, height, kernel_size);
+}
+
+BLUR_TARGET("avx2")
+static void blur_plane_cols_avx2(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+								 const int cols, const int height, const int kernel_size)
+{
+	const __m256 divisor = _mm256_set1_ps(static_cast<float>(kernel_size));
+	const int vector_cols = cols / 8 * 8;
+	alignas(64) float sums[PLANE_COLUMN_BLOCK];
+	for (int block = 0; block < vector_cols; block += PLANE_COLUMN_BLOCK)
+	{
+		const int count = std::min(PLANE_COLUMN_BLOCK, vector_cols - block);
+		const float* top = src + block;
+		float* out = dst + block;
+
+		for (int c = 0; c < count; c += 8)
+		{
+			_mm256_store_ps(sums + c, _mm256_setzero_ps());
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * src_stride;
+			for (int c = 0; c < count; c += 8)
+			{
+				_mm256_store_ps(sums + c, _mm256_add_ps(_mm256_load_ps(sums + c), _mm256_loadu_ps(in + c)));
+			}
+		}
+		for (int c = 0; c < count; c += 8)
+		{
+			_mm256_storeu_ps(out + c, _mm256_div_ps(_mm256_load_ps(sums + c), divisor));
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * src_stride;
+			const float* leaving = top + (j - 1) * src_stride;
+			float* row = out + j * dst_stride;
+			for (int c = 0; c < count; c += 8)
+			{
+				const __m256 sum = _mm256_sub_ps(_mm256_add_ps(_mm256_load_ps(sums + c), _mm256_loadu_ps(in + c)), _mm256_loadu_ps(leaving + c));
+				_mm256_store_ps(sums + c, sum);
+				_mm256_storeu_ps(row + c, _mm256_div_ps(sum, divisor));
+			}
+		}
+	}
+	blur_plane_cols_sse41(src + vector_cols, src_stride, dst + vector_cols, dst_stride, cols - vector_cols, height, kernel_size);
+}
+
+BLUR_TARGET("avx512f")
+static void blur_plane_cols_avx512(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+								   const int cols, const int height, const int kernel_size)
+{
+	const __m512 divisor = _mm512_set1_ps(static_cast<float>(kernel_size));
+	const int vector_cols = cols / 16 * 16;
+	alignas(64) float sums[PLANE_COLUMN_BLOCK];
+	for (int block = 0; block < vector_cols; block += PLANE_COLUMN_BLOCK)
+	{
+		const int count = std::min(PLANE_COLUMN_BLOCK, vector_cols - block);
+		const float* top = src + block;
+		float* out = dst + block;
+
+		for (int c = 0; c < count; c += 16)
+		{
+			_mm512_store_ps(sums + c, _mm512_setzero_ps());
+		}
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const float* in = top + k * src_stride;
+			for (int c = 0; c < count; c += 16)
+			{
+				_mm512_store_ps(sums + c, _mm512_add_ps(_mm512_load_ps(sums + c), _mm512_loadu_ps(in + c)));
+			}
+		}
+		for (int c = 0; c < count; c += 16)
+		{
+			_mm512_storeu_ps(out + c, _mm512_div_ps(_mm512_load_ps(sums + c), divisor));
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const float* in = top + (j - 1 + kernel_size) * src_stride;
+			const float* leaving = top + (j - 1) * src_stride;
+			float* row = out + j * dst_stride;
+			for (int c = 0; c < count; c += 16)
+			{
+				const __m512 sum = _mm512_sub_ps(_mm512_add_ps(_mm512_load_ps(sums + c), _mm512_loadu_ps(in + c)), _mm512_loadu_ps(leaving + c));
+				_mm512_store_ps(sums + c, sum);
+				_mm512_storeu_ps(row + c, _mm512_div_ps(sum, divisor));
+			}
+		}
+	}
+	blur_plane_cols_avx2(src + vector_cols, src_stride, dst + vector_cols, dst_stride, cols - vector_cols, height, kernel_size);
+}
+
+// The vector conversions work on 4 pixels at a time: a byte shuffle turns them from BGR(A) to RGBA (with an opaque
+// alpha byte for 24 bit pixels) or back, the rest are plain widening/narrowing conversions. The 16 byte loads of
+// 24 bit pixels read 4 bytes past the 4th pixel, so they stop 2 pixels before the end and leave them to the
+// scalar kernels.
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static inline __m128i get_bgr_order()
+{
+	return BytesPerPixel == 4 ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)
+							  : _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+}
+
+// From RGBA bytes back to the file order
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static inline __m128i get_rgba_order()
+{
+	return BytesPerPixel == 4 ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)
+							  : _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -128, -128, -128, -128);
+}
+
+// 4 pixels from src as RGBA bytes
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static inline __m128i load_bgr(const uint8_t* src)
+{
+	const __m128i opaque = _mm_set1_epi32(BytesPerPixel == 4 ? 0 : static_cast<int>(0xFF000000u));
+	return _mm_or_si128(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), get_bgr_order<BytesPerPixel>()), opaque);
+}
+
+// 4 pixels of RGBA bytes to dst in the file order
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static inline void store_bgr(uint8_t* dst, const __m128i rgba)
+{
+	const __m128i bytes = _mm_shuffle_epi8(rgba, get_rgba_order<BytesPerPixel>());
+	if (BytesPerPixel == 4)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), bytes);
+		return;
+	}
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), bytes);
+	const int last = _mm_extract_epi32(bytes, 2);
+	memcpy(dst + 8, &last, sizeof(last));
+}
+
+template <int BytesPerPixel>
+static inline bool has_4_pixels(const size_t j, const size_t count)
+{
+	return BytesPerPixel * (j + 4) + (BytesPerPixel == 4 ? 0 : 4) <= BytesPerPixel * count;
+}
+
+BLUR_TARGET("sse4.1")
+static inline __m128i encode_channels_sse41(const __m128 value)
+{
+	const __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.f));
+	return _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_set1_ps(255.f)));
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static void decode_bgr_sse41(const uint8_t* src, RGBA* dst, const size_t count)
+{
+	const __m128 scale = _mm_set1_ps(255.f);
+	float* out = reinterpret_cast<float*>(dst);
+	size_t j = 0;
+	for (; has_4_pixels<BytesPerPixel>(j, count); j += 4)
+	{
+		const __m128i rgba = load_bgr<BytesPerPixel>(src + BytesPerPixel * j);
+		_mm_storeu_ps(out + 4 * j, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(rgba)), scale));
+		_mm_storeu_ps(out + 4 * j + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(rgba, 4))), scale));
+		_mm_storeu_ps(out + 4 * j + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(rgba, 8))), scale));
+		_mm_storeu_ps(out + 4 * j + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(rgba, 12))), scale));
+	}
+	decode_bgr_scalar<BytesPerPixel>(src + BytesPerPixel * j, dst + j, count - j);
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static void encode_bgr_sse41(const RGBA* src, uint8_t* dst, const size_t count)
+{
+	const float* in = reinterpret_cast<const float*>(src);
+	size_t j = 0;
+	for (; j + 4 <= count; j += 4)
+	{
+		const __m128i pixels01 = _mm_packus_epi32(encode_channels_sse41(_mm_loadu_ps(in + 4 * j)),
+												  encode_channels_sse41(_mm_loadu_ps(in + 4 * j + 4)));
+		const __m128i pixels23 = _mm_packus_epi32(encode_channels_sse41(_mm_loadu_ps(in + 4 * j + 8)),
+												  encode_channels_sse41(_mm_loadu_ps(in + 4 * j + 12)));
+		store_bgr<BytesPerPixel>(dst + BytesPerPixel * j, _mm_packus_epi16(pixels01, pixels23));
+	}
+	encode_bgr_scalar<BytesPerPixel>(src + j, dst + BytesPerPixel * j, count - j);
+}
+
+BLUR_TARGET("avx2")
+static inline __m256i encode_channels_avx2(const __m256 value)
+{
+	const __m256 clamped = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+	return _mm256_cvtps_epi32(_mm256_mul_ps(clamped, _mm256_set1_ps(255.f)));
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("avx2")
+static void decode_bgr_avx2(const uint8_t* src, RGBA* dst, const size_t count)
+{
+	const __m256 scale = _mm256_set1_ps(255.f);
+	float* out = reinterpret_cast<float*>(dst);
+	size_t j = 0;
+	for (; has_4_pixels<BytesPerPixel>(j, count); j += 4)
+	{
+		const __m128i rgba = load_bgr<BytesPerPixel>(src + BytesPerPixel * j);
+		_mm256_storeu_ps(out + 4 * j, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(rgba)), scale));
+		_mm256_storeu_ps(out + 4 * j + 8, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(rgba, 8))), scale));
+	}
+	decode_bgr_scalar<BytesPerPixel>(src + BytesPerPixel * j, dst + j, count - j);
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("avx2")
+static void encode_bgr_avx2(const RGBA* src, uint8_t* dst, const size_t count)
+{
+	const float* in = reinterpret_cast<const float*>(src);
+	size_t j = 0;
+	for (; j + 4 <= count; j += 4)
+	{
+		// The 256 bit pack works on each half on its own, the permutation puts the 4 pixels back in order
+		const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(encode_channels_avx2(_mm256_loadu_ps(in + 4 * j)),
+																		   encode_channels_avx2(_mm256_loadu_ps(in + 4 * j + 8))),
+													   0xD8);
+		store_bgr<BytesPerPixel>(dst + BytesPerPixel * j, _mm_packus_epi16(_mm256_castsi256_si128(words),
+																		   _mm256_extracti128_si256(words, 1)));
+	}
+	encode_bgr_scalar<BytesPerPixel>(src + j, dst + BytesPerPixel * j, count - j);
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("avx512f")
+static void decode_bgr_avx512(const uint8_t* src, RGBA* dst, const size_t count)
+{
+	const __m512 scale = _mm512_set1_ps(255.f);
+	float* out = reinterpret_cast<float*>(dst);
+	size_t j = 0;
+	for (; has_4_pixels<BytesPerPixel>(j, count); j += 4)
+	{
+		const __m128i rgba = load_bgr<BytesPerPixel>(src + BytesPerPixel * j);
+		_mm512_storeu_ps(out + 4 * j, _mm512_div_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(rgba)), scale));
+	}
+	decode_bgr_scalar<BytesPerPixel>(src + BytesPerPixel * j, dst + j, count - j);
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("avx512f")
+static void encode_bgr_avx512(const RGBA* src, uint8_t* dst, const size_t count)
+{
+	const float* in = reinterpret_cast<const float*>(src);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 one = _mm512_set1_ps(1.f);
+	const __m512 scale = _mm512_set1_ps(255.f);
+	size_t j = 0;
+	for (; j + 4 <= count; j += 4)
+	{
+		const __m512 clamped = _mm512_min_ps(_mm512_max_ps(_mm512_loadu_ps(in + 4 * j), zero), one);
+		store_bgr<BytesPerPixel>(dst + BytesPerPixel * j, _mm512_cvtusepi32_epi8(_mm512_cvtps_epi32(_mm512_mul_ps(clamped, scale))));
+	}
+	encode_bgr_scalar<BytesPerPixel>(src + j, dst + BytesPerPixel * j, count - j);
+}
+
+// Planar conversions: the same 4 pixels of RGBA bytes are transposed to 4 bytes of each channel (the shuffle is its
+// own inverse, so it transposes them back as well). The wider instruction sets use these too, the conversions of
+// the interleaved pixels don't gain much more from them either.
+BLUR_TARGET("sse4.1")
+static inline __m128i transpose_channels(const __m128i bytes)
+{
+	return _mm_shuffle_epi8(bytes, _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static void decode_bgr_planes_sse41(const uint8_t* src, float* const* planes, const size_t count)
+{
+	const __m128 scale = _mm_set1_ps(255.f);
+	size_t j = 0;
+	for (; has_4_pixels<BytesPerPixel>(j, count); j += 4)
+	{
+		const __m128i channels = transpose_channels(load_bgr<BytesPerPixel>(src + BytesPerPixel * j));
+		_mm_storeu_ps(planes[0] + j, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(channels)), scale));
+		_mm_storeu_ps(planes[1] + j, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(channels, 4))), scale));
+		_mm_storeu_ps(planes[2] + j, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(channels, 8))), scale));
+		if (BytesPerPixel == 4)
+		{
+			_mm_storeu_ps(planes[3] + j, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(channels, 12))), scale));
+		}
+	}
+	float* const rest[4] = { planes[0] + j, planes[1] + j, planes[2] + j, BytesPerPixel == 4 ? planes[3] + j : nullptr };
+	decode_bgr_planes_scalar<BytesPerPixel>(src + BytesPerPixel * j, rest, count - j);
+}
+
+template <int BytesPerPixel>
+BLUR_TARGET("sse4.1")
+static void encode_bgr_planes_sse41(const float* const* planes, uint8_t* dst, const size_t count)
+{
+	size_t j = 0;
+	for (; j + 4 <= count; j += 4)
+	{
+		const __m128i alpha = (BytesPerPixel == 4 ? encode_channels_sse41(_mm_loadu_ps(planes[3] + j)) : _mm_setzero_si128());
+		const __m128i red_green = _mm_packus_epi32(encode_channels_sse41(_mm_loadu_ps(planes[0] + j)),
+												   encode_channels_sse41(_mm_loadu_ps(planes[1] + j)));
+		const __m128i blue_alpha = _mm_packus_epi32(encode_channels_sse41(_mm_loadu_ps(planes[2] + j)), alpha);
+		store_bgr<BytesPerPixel>(dst + BytesPerPixel * j, transpose_channels(_mm_packus_epi16(red_green, blue_alpha)));
+	}
+	const float* const rest[4] = { planes[0] + j, planes[1] + j, planes[2] + j, BytesPerPixel == 4 ? planes[3] + j : nullptr };
+	encode_bgr_planes_scalar<BytesPerPixel>(rest, dst + BytesPerPixel * j, count - j);
+}
+
+// One entry point per instruction set, picking the pixel size once per call
+#define BLUR_BGR_CONVERSIONS(isa) \
+	static void decode_bgr_##isa(const uint8_t* src, RGBA* dst, const size_t count, const int bytes_per_pixel) \
+	{ \
+		bytes_per_pixel == 4 ? decode_bgr_##isa<4>(src, dst, count) : decode_bgr_##isa<3>(src, dst, count); \
+	} \
+	static void encode_bgr_##isa(const RGBA* src, uint8_t* dst, const size_t count, const int bytes_per_pixel) \
+	{ \
+		bytes_per_pixel == 4 ? encode_bgr_##isa<4>(src, dst, count) : encode_bgr_##isa<3>(src, dst, count); \
+	}
+BLUR_BGR_CONVERSIONS(sse41)
+BLUR_BGR_CONVERSIONS(avx2)
+BLUR_BGR_CONVERSIONS(avx512)
+
+static void decode_bgr_planes_sse41(const uint8_t* src, float* const* planes, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? decode_bgr_planes_sse41<4>(src, planes, count) : decode_bgr_planes_sse41<3>(src, planes, count);
+}
+
+static void encode_bgr_planes_sse41(const float* const* planes, uint8_t* dst, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? encode_bgr_planes_sse41<4>(planes, dst, count) : encode_bgr_planes_sse41<3>(planes, dst, count);
+}
+#undef BLUR_BGR_CONVERSIONS
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static void cpuid(int regs[4], const int leaf, const int subleaf)
+{
+#if defined(_MSC_VER)
+	__cpuidex(regs, leaf, subleaf);
+#else
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+	__cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+	regs[0] = static_cast<int>(eax);
+	regs[1] = static_cast<int>(ebx);
+	regs[2] = static_cast<int>(ecx);
+	regs[3] = static_cast<int>(edx);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0), wider registers are useless without it
+static uint64_t xgetbv()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax = 0, edx = 0;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+#endif
+
+
+// Rounded division by the kernel size through a multiplication by its reciprocal (scaled by 2^40). It's exact
+// as long as sum * (reciprocal rounding error) < 2^40, which holds for any 8-bit running sum: the kernel size
+// fits in 15 bits and the sum of a whole kernel in 23.
+struct ReciprocalDivider
+{
+	explicit ReciprocalDivider(const int divisor)
+		: reciprocal(((static_cast<uint64_t>(1) << 40) + divisor - 1) / divisor),
+		  half(static_cast<uint32_t>(divisor / 2)) {}
+
+	uint8_t operator () (const uint32_t sum) const
+	{
+		return static_cast<uint8_t>((static_cast<uint64_t>(sum + half) * reciprocal) >> 40);
+	}
+
+	uint64_t reciprocal;
+	uint32_t half;
+};
+
+void blur_rows_packed(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					  const int rows, const int width, const int kernel_size)
+{
+	const ReciprocalDivider divide(kernel_size);
+	for (int i = 0; i < rows; i++) // Row index
+	{
+		const uint8_t* in = src + 4 * i * src_stride;
+		uint8_t* out = dst + 4 * i * dst_stride;
+
+		// Initialize the sums over the first window, then slide it one pixel at a time
+		uint32_t blue = 0, green = 0, red = 0;
+		int k = 0;
+		for (; k < kernel_size; k++)
+		{
+			blue += in[4 * k];
+			green += in[4 * k + 1];
+			red += in[4 * k + 2];
+		}
+		out[0] = divide(blue);
+		out[1] = divide(green);
+		out[2] = divide(red);
+		out[3] = 0xFF;
+
+		for (int j = 1; j < width; j++, k++) // Col index
+		{
+			const uint8_t* entering = in + 4 * k;
+			const uint8_t* leaving = in + 4 * (k - kernel_size);
+			blue += entering[0] - leaving[0];
+			green += entering[1] - leaving[1];
+			red += entering[2] - leaving[2];
+			out[4 * j] = divide(blue);
+			out[4 * j + 1] = divide(green);
+			out[4 * j + 2] = divide(red);
+			out[4 * j + 3] = 0xFF;
+		}
+	}
+}
+
+void blur_cols_packed(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					  const int cols, const int height, const int kernel_size)
+{
+	const ptrdiff_t in_stride = 4 * src_stride;
+	const ptrdiff_t out_stride = 4 * dst_stride;
+	const ReciprocalDivider divide(kernel_size);
+	uint32_t sums[4 * COLUMN_BLOCK];
+	for (int block = 0; block < cols; block += COLUMN_BLOCK)
+	{
+		const int bytes = 4 * std::min(COLUMN_BLOCK, cols - block);
+		const uint8_t* top = src + 4 * block;
+		uint8_t* out = dst + 4 * block;
+
+		// The alpha byte is summed along with the colors (it's cheaper than skipping it), but never stored
+		std::fill(sums, sums + bytes, 0);
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const uint8_t* in = top + k * in_stride;
+			for (int c = 0; c < bytes; c++)
+			{
+				sums[c] += in[c];
+			}
+		}
+		for (int c = 0; c < bytes; c += 4)
+		{
+			out[c] = divide(sums[c]);
+			out[c + 1] = divide(sums[c + 1]);
+			out[c + 2] = divide(sums[c + 2]);
+			out[c + 3] = 0xFF;
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const uint8_t* in = top + (j - 1 + kernel_size) * in_stride;
+			const uint8_t* leaving = top + (j - 1) * in_stride;
+			uint8_t* row = out + j * out_stride;
+			for (int c = 0; c < bytes; c++)
+			{
+				sums[c] += in[c] - leaving[c];
+			}
+			for (int c = 0; c < bytes; c += 4)
+			{
+				row[c] = divide(sums[c]);
+				row[c + 1] = divide(sums[c + 1]);
+				row[c + 2] = divide(sums[c + 2]);
+				row[c + 3] = 0xFF;
+			}
+		}
+	}
+}
+
+// The gray ones are the same on a single channel, a byte per pixel. Columns go by blocks 4 times as wide, so the
+// sums take the same room.
+static const int GRAY_COLUMN_BLOCK = 4 * COLUMN_BLOCK;
+
+void blur_rows_gray(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					const int rows, const int width, const int kernel_size)
+{
+	const ReciprocalDivider divide(kernel_size);
+	for (int i = 0; i < rows; i++) // Row index
+	{
+		const uint8_t* in = src + i * src_stride;
+		uint8_t* out = dst + i * dst_stride;
+
+		uint32_t sum = 0;
+		int k = 0;
+		for (; k < kernel_size; k++)
+		{
+			sum += in[k];
+		}
+		out[0] = divide(sum);
+		for (int j = 1; j < width; j++, k++) // Col index
+		{
+			sum += in[k] - in[k - kernel_size];
+			out[j] = divide(sum);
+		}
+	}
+}
+
+void blur_cols_gray(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					const int cols, const int height, const int kernel_size)
+{
+	const ReciprocalDivider divide(kernel_size);
+	uint32_t sums[GRAY_COLUMN_BLOCK];
+	for (int block = 0; block < cols; block += GRAY_COLUMN_BLOCK)
+	{
+		const int count = std::min(GRAY_COLUMN_BLOCK, cols - block);
+		const uint8_t* top = src + block;
+		uint8_t* out = dst + block;
+
+		std::fill(sums, sums + count, 0);
+		for (int k = 0; k < kernel_size; k++)
+		{
+			const uint8_t* in = top + k * src_stride;
+			for (int c = 0; c < count; c++)
+			{
+				sums[c] += in[c];
+			}
+		}
+		for (int c = 0; c < count; c++)
+		{
+			out[c] = divide(sums[c]);
+		}
+
+		for (int j = 1; j < height; j++) // Row index
+		{
+			const uint8_t* in = top + (j - 1 + kernel_size) * src_stride;
+			const uint8_t* leaving = top + (j - 1) * src_stride;
+			uint8_t* row = out + j * dst_stride;
+			for (int c = 0; c < count; c++)
+			{
+				sums[c] += in[c] - leaving[c];
+				row[c] = divide(sums[c]);
+			}
+		}
+	}
+}
+
+BlurISA detect_blur_isa()
+{
+#if defined(BLUR_X86)
+	int regs[4];
+	cpuid(regs, 0, 0);
+	const int max_leaf = regs[0];
+
+	cpuid(regs, 1, 0);
+	const bool sse41 = (regs[2] & (1 << 19)) != 0;
+	const bool osxsave = (regs[2] & (1 << 27)) != 0;
+	const bool avx = (regs[2] & (1 << 28)) != 0;
+	if (!sse41)
+	{
+		return BlurISA::SCALAR;
+	}
+
+	// XMM and YMM state (bits 1, 2), then opmask and ZMM state (bits 5, 6, 7)
+	const uint64_t xcr0 = osxsave ? xgetbv() : 0;
+	const bool os_avx = avx && (xcr0 & 0x06) == 0x06;
+	const bool os_avx512 = os_avx && (xcr0 & 0xE0) == 0xE0;
+	if (!os_avx || max_leaf < 7)
+	{
+		return BlurISA::SSE4_1;
+	}
+
+	cpuid(regs, 7, 0);
+	const bool avx2 = (regs[1] & (1 << 5)) != 0;
+	const bool avx512f = (regs[1] & (1 << 16)) != 0;
+	if (os_avx512 && avx512f)
+	{
+		return BlurISA::AVX512;
+	}
+	return avx2 ? BlurISA::AVX2 : BlurISA::SSE4_1;
+#else
+	return BlurISA::SCALAR;
+#endif
+}
+
+bool is_blur_isa_supported(BlurISA isa)
+{
+	// The instruction sets are strictly ordered, each one implies the ones before it
+	return isa == BlurISA::AUTO || static_cast<uint8_t>(isa) <= static_cast<uint8_t>(detect_blur_isa());
+}
+
+static BlurKernels get_kernels_for(BlurISA isa)
+{
+	switch (isa)
+	{
+#if defined(BLUR_X86)
+	case BlurISA::SSE4_1:
+		return { blur_rows_sse41, blur_cols_sse41, blur_plane_rows_sse41, blur_plane_cols_sse41, decode_bgr_sse41, encode_bgr_sse41,
+				 decode_bgr_planes_sse41, encode_bgr_planes_sse41 };
+	case BlurISA::AVX2:
+		return { blur_rows_avx2, blur_cols_avx2, blur_plane_rows_sse41, blur_plane_cols_avx2, decode_bgr_avx2, encode_bgr_avx2,
+				 decode_bgr_planes_sse41, encode_bgr_planes_sse41 };
+	case BlurISA::AVX512:
+		return { blur_rows_avx512, blur_cols_avx512, blur_plane_rows_sse41, blur_plane_cols_avx512, decode_bgr_avx512,
+				 encode_bgr_avx512, decode_bgr_planes_sse41, encode_bgr_planes_sse41 };
+#endif
+	case BlurISA::SCALAR:
+	default:
+		return { blur_rows_scalar, blur_cols_scalar, blur_plane_rows_scalar, blur_plane_cols_scalar, decode_bgr_scalar,
+				 encode_bgr_scalar, decode_bgr_planes_scalar, encode_bgr_planes_scalar };
+	}
+}
+
+// Picked once at startup from CPUID, unless overridden with set_blur_isa
+static BlurISA active_isa = detect_blur_isa();
+static BlurKernels active_kernels = get_kernels_for(active_isa);
+
+void set_blur_isa(BlurISA isa)
+{
+	if (!is_blur_isa_supported(isa))
+	{
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "%s instruction set is not supported by this CPU", get_blur_isa_name(isa).c_str());
+		throw std::domain_error(buffer);
+	}
+
+	active_isa = (isa == BlurISA::AUTO ? detect_blur_isa() : isa);
+	active_kernels = get_kernels_for(active_isa);
+}
+
+BlurISA get_blur_isa()
+{
+	return active_isa;
+}
+
+const BlurKernels& get_blur_kernels()
+{
+	return active_kernels;
+}
+
+BlurISA parse_blur_isa(const std::string& name)
+{
+	if (name == "scalar")
+	{
+		return BlurISA::SCALAR;
+	}
+	if (name == "sse4.1")
+	{
+		return BlurISA::SSE4_1;
+	}
+	if (name == "avx2")
+	{
+		return BlurISA::AVX2;
+	}
+	if (name == "avx512")
+	{
+		return BlurISA::AVX512;
+	}
+	if (name == "auto")
+	{
+		return BlurISA::AUTO;
+	}
+
+	char buffer[100];
+	snprintf(buffer, sizeof(buffer), "Unknown instruction set %s (scalar, sse4.1, avx2, avx512, auto)", name.c_str());
+	throw std::invalid_argument(buffer);
+}
+
+std::string get_blur_isa_name(BlurISA isa)
+{
+	switch (isa)
+	{
+	case BlurISA::SCALAR:
+		return "scalar";
+	case BlurISA::SSE4_1:
+		return "sse4.1";
+	case BlurISA::AVX2:
+		return "avx2";
+	case BlurISA::AVX512:
+		return "avx512";
+	case BlurISA::AUTO:
+	default:
+		return "auto";
+	}
+}
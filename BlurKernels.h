@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ImageBlur.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+
+enum class BlurISA : uint8_t
+{
+	SCALAR,
+	SSE4_1,
+	AVX2,
+	AVX512,
+	AUTO
+};
+
+// The two running average passes of the separable box blur (on RGBA pixels or on single float planes), and the
+// conversions of the pixels in and out of the float engines. Every implementation produces bit-identical results,
+// they only differ in how many rows/columns (or pixels) they carry at once.
+// Strides are in pixels, the sources already include the kernel_size / 2 mirrored pixels on both ends.
+struct BlurKernels
+{
+	// Horizontal pass over rows of width + kernel_size - 1 source pixels
+	void (*blur_rows)(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+					  const int rows, const int width, const int kernel_size);
+	// Vertical pass over columns of height + kernel_size - 1 source pixels
+	void (*blur_cols)(const RGBA* src, const ptrdiff_t src_stride, RGBA* dst, const ptrdiff_t dst_stride,
+					  const int cols, const int height, const int kernel_size);
+	// Same two passes on a single float plane of a planar image (strides in floats)
+	void (*blur_plane_rows)(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+							const int rows, const int width, const int kernel_size);
+	void (*blur_plane_cols)(const float* src, const ptrdiff_t src_stride, float* dst, const ptrdiff_t dst_stride,
+							const int cols, const int height, const int kernel_size);
+	// count 8-bit BGR or BGRA pixels (bytes_per_pixel 3 or 4) to float RGBA and back, see decode_bgr_pixels()
+	void (*decode_bgr)(const uint8_t* src, RGBA* dst, const size_t count, const int bytes_per_pixel);
+	void (*encode_bgr)(const RGBA* src, uint8_t* dst, const size_t count, const int bytes_per_pixel);
+	// Same with the red, green, blue (and alpha, for 4 bytes per pixel) planes of a planar image
+	void (*decode_bgr_planes)(const uint8_t* src, float* const* planes, const size_t count, const int bytes_per_pixel);
+	void (*encode_bgr_planes)(const float* const* planes, uint8_t* dst, const size_t count, const int bytes_per_pixel);
+};
+
+// Best instruction set available on the running CPU (and enabled by the OS)
+BlurISA detect_blur_isa();
+bool is_blur_isa_supported(BlurISA isa);
+
+// Overrides the instruction set picked at startup, AUTO goes back to the detected one
+void set_blur_isa(BlurISA isa);
+BlurISA get_blur_isa();
+const BlurKernels& get_blur_kernels();
+
+BlurISA parse_blur_isa(const std::string& name);
+std::string get_blur_isa_name(BlurISA isa);
+
+// Integer engine passes, on packed 8-bit BGRA pixels (same layout and strides of the float ones). The running
+// sums are exact 32 bit integers and every pass rounds to the nearest value, alpha is set to opaque like the
+// float engine does.
+void blur_rows_packed(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					  const int rows, const int width, const int kernel_size);
+void blur_cols_packed(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					  const int cols, const int height, const int kernel_size);
+// Same passes on single channel 8-bit gray pixels
+void blur_rows_gray(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					const int rows, const int width, const int kernel_size);
+void blur_cols_gray(const uint8_t* src, const ptrdiff_t src_stride, uint8_t* dst, const ptrdiff_t dst_stride,
+					const int cols, const int height, const int kernel_size);
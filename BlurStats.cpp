@@ -0,0 +1,107 @@
+#include "BlurStats.h"
+#include <stdexcept>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+
+StatsFormat parse_stats_format(const std::string& name)
+{
+	if (name == "text")
+	{
+		return StatsFormat::TEXT;
+	}
+	if (name == "json")
+	{
+		return StatsFormat::JSON;
+	}
+	char buffer[100];
+	snprintf(buffer, sizeof(buffer), "Unknown stats format: %s", name.c_str());
+	throw std::invalid_argument(buffer);
+}
+
+static std::string escape_json(const std::string& text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (const char c : text)
+	{
+		if (c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20)
+		{
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+			escaped += code;
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+std::string format_stats(const BlurStats& stats, StatsFormat format, const std::string& path)
+{
+	if (format == StatsFormat::NONE)
+	{
+		return std::string();
+	}
+
+	const double total = stats.parse + stats.blur + stats.write;
+	const double pixels = static_cast<double>(stats.width) * stats.height;
+	const double mpix_s = stats.blur > 0.0 ? pixels / stats.blur / 1e6 : 0.0;
+	// The path goes last, everything before it has a bounded length
+	char buffer[512];
+	if (format == StatsFormat::JSON)
+	{
+		snprintf(buffer, sizeof(buffer),
+				 "{\"width\":%d,\"height\":%d,\"kernel_size\":%d,\"pad\":%d,\"scale\":%d,\"parse_ms\":%.3f,\"blur_ms\":%.3f,"
+				 "\"rows_ms\":%.3f,\"cols_ms\":%.3f,\"write_ms\":%.3f,\"total_ms\":%.3f,\"blur_mpix_s\":%.2f,"
+				 "\"pixel_bytes\":%zu,\"scratch_bytes\":%zu,\"file_bytes\":%zu,\"peak_rss_kb\":%lld,\"path\":\"",
+				 stats.width, stats.height, stats.kernel_size, stats.pad, stats.scale, stats.parse * 1e3, stats.blur * 1e3,
+				 stats.blur_rows * 1e3, stats.blur_cols * 1e3, stats.write * 1e3, total * 1e3, mpix_s,
+				 stats.pixel_bytes, stats.scratch_bytes, stats.file_bytes, get_peak_working_set_kb());
+		return buffer + escape_json(path) + "\"}";
+	}
+	snprintf(buffer, sizeof(buffer),
+			 "width=%d height=%d kernel_size=%d pad=%d scale=%d parse_ms=%.3f blur_ms=%.3f rows_ms=%.3f cols_ms=%.3f "
+			 "write_ms=%.3f total_ms=%.3f blur_mpix_s=%.2f pixel_bytes=%zu scratch_bytes=%zu file_bytes=%zu "
+			 "peak_rss_kb=%lld path=",
+			 stats.width, stats.height, stats.kernel_size, stats.pad, stats.scale, stats.parse * 1e3, stats.blur * 1e3,
+			 stats.blur_rows * 1e3, stats.blur_cols * 1e3, stats.write * 1e3, total * 1e3, mpix_s,
+			 stats.pixel_bytes, stats.scratch_bytes, stats.file_bytes, get_peak_working_set_kb());
+	return buffer + path;
+}
+
+long long get_peak_working_set_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return static_cast<long long>(counters.PeakWorkingSetSize / 1024);
+	}
+	return 0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024; // Bytes there
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+
+// Wall clock seconds spent in each stage of the work on an image, plus what it took in memory. TGA adds to the
+// one given to set_stats(), with none set (the default) nothing is timed or counted at all.
+struct BlurStats
+{
+	double parse = 0.0;
+	double blur = 0.0;      // Whole blur, whatever the mode
+	double blur_rows = 0.0; // Horizontal passes (box and gaussian modes)
+	double blur_cols = 0.0; // Vertical passes (box and gaussian modes)
+	double write = 0.0;
+
+	int width = 0;
+	int height = 0;
+	int kernel_size = 0;    // Effective kernel size of the last blur (0 when the factor was too small to blur)
+	int pad = 0;            // Mirrored pixels on each side, kernel_size / 2
+	int scale = 1;          // Downsampling of the approximate mode, 1 for the exact ones
+
+	size_t pixel_bytes = 0;   // Pixel buffer allocated by parse (0 when the previous one was big enough)
+	size_t scratch_bytes = 0; // Working buffers of the blur: lines, strips, tables or padded copies
+	size_t file_bytes = 0;    // Input plus output file bytes, mapped or buffered
+};
+
+enum class StatsFormat : uint8_t
+{
+	NONE,
+	TEXT, // key=value pairs
+	JSON  // one object
+};
+
+StatsFormat parse_stats_format(const std::string& name);
+
+// One line report (no newline at the end) of the stats of the image at path, with the peak working set of the
+// process so far
+std::string format_stats(const BlurStats& stats, StatsFormat format, const std::string& path);
+
+// Peak resident memory of the whole process, in KiB (0 when the OS can't tell)
+long long get_peak_working_set_kb();
+
+// Adds the time between its construction and its destruction to seconds, a null pointer skips the clock calls
+class ScopedTimer
+{
+public:
+
+	explicit ScopedTimer(double* seconds) : seconds(seconds)
+	{
+		if (seconds)
+		{
+			start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~ScopedTimer()
+	{
+		if (seconds)
+		{
+			*seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator = (const ScopedTimer&) = delete;
+
+private:
+
+	double* seconds;
+	std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,114 @@
+#include "BlurWorkspace.h"
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+// Only buffers this big are worth huge pages (the size of one on x86-64)
+static const size_t HUGE_PAGE_SIZE = static_cast<size_t>(2) << 20;
+
+BlurWorkspace::BlurWorkspace(bool huge_pages) : huge_pages(huge_pages)
+{
+}
+
+BlurWorkspace::~BlurWorkspace()
+{
+	release();
+}
+
+void* BlurWorkspace::get_buffer(int index, size_t size)
+{
+	if (index < 0 || index >= BUFFER_COUNT)
+	{
+		throw std::out_of_range("Invalid workspace buffer index");
+	}
+
+	Buffer& buffer = buffers[index];
+	if (size <= buffer.size && buffer.data)
+	{
+		return buffer.data;
+	}
+	free_buffer(buffer);
+
+	// Some room to spare, images a bit bigger than the last one don't need a new buffer each
+	size = std::max<size_t>(size + size / 8, ALIGNMENT);
+#ifndef _WIN32
+	if (huge_pages && size >= HUGE_PAGE_SIZE)
+	{
+		size = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data != MAP_FAILED)
+		{
+#ifdef MADV_HUGEPAGE
+			madvise(data, size, MADV_HUGEPAGE);
+#endif
+			buffer = { data, size, true };
+			allocations++;
+			return data;
+		}
+	}
+#endif
+
+	size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+#ifdef _WIN32
+	void* data = _aligned_malloc(size, ALIGNMENT);
+#else
+	void* data = nullptr;
+	if (posix_memalign(&data, ALIGNMENT, size) != 0)
+	{
+		data = nullptr;
+	}
+#endif
+	if (!data)
+	{
+		throw std::bad_alloc();
+	}
+	buffer = { data, size, false };
+	allocations++;
+	return data;
+}
+
+size_t BlurWorkspace::get_reserved_bytes() const
+{
+	size_t bytes = 0;
+	for (const Buffer& buffer : buffers)
+	{
+		bytes += buffer.size;
+	}
+	return bytes;
+}
+
+void BlurWorkspace::release()
+{
+	for (Buffer& buffer : buffers)
+	{
+		free_buffer(buffer);
+	}
+}
+
+void BlurWorkspace::free_buffer(Buffer& buffer)
+{
+	if (buffer.data)
+	{
+#ifdef _WIN32
+		_aligned_free(buffer.data);
+#else
+		if (buffer.mapped)
+		{
+			munmap(buffer.data, buffer.size);
+		}
+		else
+		{
+			free(buffer.data);
+		}
+#endif
+	}
+	buffer = Buffer();
+}
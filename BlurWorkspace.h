@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Scratch memory of the blur: a few buffers that grow when a call needs more and are kept for the next ones, so
+// once they're big enough for the largest image blurring does no heap allocation at all. Buffers are aligned to
+// a cache line. With huge pages the large ones are mapped on their own and backed by huge pages where the OS
+// offers them (transparent huge pages on Linux), to save TLB misses and page faults on big images.
+// A workspace is used by one blur at a time (its bands share it, each one in its own part of the buffers).
+class BlurWorkspace
+{
+public:
+
+	static constexpr int BUFFER_COUNT = 3;
+	static constexpr size_t ALIGNMENT = 64;
+
+	explicit BlurWorkspace(bool huge_pages = false);
+	~BlurWorkspace();
+
+	BlurWorkspace(const BlurWorkspace&) = delete;
+	BlurWorkspace& operator = (const BlurWorkspace&) = delete;
+
+	// Buffer number index (less than BUFFER_COUNT) with room for at least size bytes. Growing it doesn't keep
+	// what was in it.
+	void* get_buffer(int index, size_t size);
+
+	template <typename T>
+	T* get_buffer(int index, size_t count) { return static_cast<T*>(get_buffer(index, count * sizeof(T))); }
+
+	// Bytes held by all the buffers
+	size_t get_reserved_bytes() const;
+	// Number of times a buffer had to grow since the workspace was made
+	long long get_allocation_count() const { return allocations; }
+
+	// Frees every buffer
+	void release();
+
+private:
+
+	struct Buffer
+	{
+		void* data = nullptr;
+		size_t size = 0;
+		bool mapped = false;
+	};
+
+	void free_buffer(Buffer& buffer);
+
+	bool huge_pages;
+	Buffer buffers[BUFFER_COUNT];
+	long long allocations = 0;
+};
@@ -1,89 +1,80 @@
 #include "BlurringFilter.h"
+#include "StreamBlur.h"
+#include "MappedFile.h"
+#include "BlurStats.h"
 #include <fstream> 
+#include <iostream>
 #include <stdexcept>
 #include <stdio.h>
 #include <string>
+#include <string.h>
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 
-RGBA::RGBA() : red(0.f), green(0.f), blue(0.f), alpha(1.f) {}
-RGBA::RGBA(float c, float a) : red(c), green(c), blue(c), alpha(a) {}
-RGBA::RGBA(float r, float g, float b, float a) : red(r), green(g), blue(b), alpha(a) {}
-
-bool operator == (const RGBA& lhs, const RGBA& rhs)
-{
-	return lhs.red == rhs.red && lhs.green == rhs.green &&
-		   lhs.blue == rhs.blue && lhs.alpha == rhs.alpha;
-}
-
-bool operator != (const RGBA& lhs, const RGBA& rhs)
-{
-	return !(lhs == rhs);
-}
-
-RGBA& RGBA::operator += (const RGBA& rhs)
+TGA::TGA(const std::string& path, BlurEngine engine) : engine(engine)
 {
-	red += rhs.red;
-	green += rhs.green;
-	blue += rhs.blue;
-	return *this;
-}
-
-RGBA operator + (RGBA lhs, const RGBA& rhs)
-{
-	return lhs += rhs;
+	parse(path);
 }
 
-RGBA& RGBA::operator -= (const RGBA& rhs)
+TGA::TGA(BlurEngine engine) : engine(engine)
 {
-	red -= rhs.red;
-	green -= rhs.green;
-	blue -= rhs.blue;
-	return *this;
 }
 
-RGBA operator - (RGBA lhs, const RGBA& rhs)
+TGA::~TGA()
 {
-	return lhs -= rhs;
+	// This prevents memory leak on exceptions thrown (and follows RAII)
+	delete[] pixels;
+	delete[] packed_pixels;
+	delete[] planes;
+	delete[] gray_pixels;
 }
 
-RGBA& RGBA::operator *= (const RGBA& rhs)
+void TGA::set_stats(BlurStats* stats)
 {
-	red *= rhs.red;
-	green *= rhs.green;
-	blue *= rhs.blue;
-	return *this;
+	this->stats = stats;
 }
 
-RGBA operator * (RGBA lhs, const RGBA& rhs)
+void TGA::set_workspace(BlurWorkspace* workspace)
 {
-	return lhs *= rhs;
+	this->workspace = workspace;
 }
 
-RGBA& RGBA::operator /= (const RGBA& rhs)
+void TGA::set_threads(int threads)
 {
-	red /= rhs.red;
-	green /= rhs.green;
-	blue /= rhs.blue;
-	return *this;
+	if (threads < 1)
+	{
+		throw std::invalid_argument("Invalid thread count (it needs to be at least 1)");
+	}
+	this->threads = threads;
 }
 
-RGBA operator / (RGBA lhs, const RGBA & rhs)
+void TGA::set_tolerance(float tolerance)
 {
-	return lhs /= rhs;
+	if (!(tolerance > 0.f && tolerance <= 0.25f))
+	{
+		throw std::invalid_argument("Invalid tolerance (it needs to be in the 0 < t <= 0.25 range)");
+	}
+	this->tolerance = tolerance;
 }
 
-TGA::TGA(const std::string& path)
+int TGA::get_width() const
 {
-	parse(path);
+	return static_cast<int>(header.image_width);
 }
 
-TGA::~TGA()
+int TGA::get_height() const
 {
-	// This prevents memory leak on exceptions thrown (and follows RAII)
-	delete[] in_buffer;
-	delete[] out_buffer;
-	delete[] pixels;
+	return static_cast<int>(header.image_height);
 }
 
 TGAImageType TGA::get_image_type() const
@@ -93,7 +84,7 @@ TGAImageType TGA::get_image_type() const
 
 std::string TGA::get_image_type_name() const
 {
-	switch (header.image_type)
+	switch (get_image_type())
 	{
 	case TGAImageType::COLOR_MAPPED: 
 		return TYPE_COLOR_MAPPED_NAME;
@@ -113,66 +104,299 @@ std::string TGA::get_image_type_name() const
 	}
 }
 
+int TGA::get_data_offset() const
+{
+	int start_offset = 18; // Starting from the first byte after the header
+	start_offset += static_cast<int>(header.id_length); // Skipping image id field
+	if (header.color_map_type != 0) // Skipping color map data field
+	{
+		// When need to ceil to get the right amount of bytes because the number of bits may be 15
+		start_offset += static_cast<int>(header.color_map_length) * 
+						((static_cast<int>(header.color_map_entry_size) + 7) / 8);
+	}
+	return start_offset;
+}
+
+int TGA::get_kernel_size(float factor) const
+{
+	return get_blur_kernel_size(get_width(), get_height(), factor);
+}
+
 RGBA* TGA::get_mirror_padded_image(const int pad) const
 {
-	const int image_height = static_cast<int>(header.image_height);
-	const int image_width = static_cast<int>(header.image_width);
-	if (pad > image_height || pad > image_width)
+	return ::get_mirror_padded_image(get_view(), pad);
+}
+
+void TGA::copy_header_from(const TGA& other)
+{
+	if (other.engine != engine)
 	{
-		throw std::invalid_argument("Pad size cannot exceed the dimensions of the image");
+		throw std::invalid_argument("Images of different engines cannot be copied");
 	}
+	// The header first, the number of planes depends on it
+	buffer_size = other.buffer_size;
+	format = other.format;
+	image_type = other.image_type;
+	horiz_orient = other.horiz_orient;
+	vert_orient = other.vert_orient;
+	header = other.header;
+	footer = other.footer;
 
-	const int padded_img_height = image_height + 2 * pad;
-	const int padded_img_width = image_width + 2 * pad;
-	RGBA* padded_img = new RGBA[padded_img_height * padded_img_width];
-	if (padded_img && pixels)
+	reserve_pixels(static_cast<size_t>(other.get_width()) * other.get_height());
+}
+
+void TGA::copy_from(const TGA& other)
+{
+	copy_header_from(other);
+	const size_t pixel_count = static_cast<size_t>(other.get_width()) * other.get_height();
+	if (is_mono())
+	{
+		std::copy(other.gray_pixels, other.gray_pixels + pixel_count, gray_pixels);
+	}
+	else if (engine == BlurEngine::INTEGER)
 	{
-		for (int i = 0; i < padded_img_height; i++)
+		std::copy(other.packed_pixels, other.packed_pixels + pixel_count, packed_pixels);
+	}
+	else if (engine == BlurEngine::PLANAR)
+	{
+		std::copy(other.planes, other.planes + pixel_count * get_plane_count(), planes);
+	}
+	else
+	{
+		std::copy(other.pixels, other.pixels + pixel_count, pixels);
+	}
+}
+
+size_t TGA::get_pixel_bytes() const
+{
+	const PixelLayout layout = get_layout();
+	return static_cast<size_t>(get_width()) * get_height() * get_pixel_size(layout) * ::get_plane_count(layout);
+}
+
+PixelLayout TGA::get_layout() const
+{
+	if (is_mono())
+	{
+		return PixelLayout::GRAY8;
+	}
+	if (engine == BlurEngine::INTEGER)
+	{
+		return PixelLayout::BGRA8;
+	}
+	if (engine == BlurEngine::PLANAR)
+	{
+		return get_plane_count() == 4 ? PixelLayout::PLANAR_RGBA_F32 : PixelLayout::PLANAR_RGB_F32;
+	}
+	return PixelLayout::RGBA_F32;
+}
+
+ImageView TGA::get_view() const
+{
+	const PixelLayout layout = get_layout();
+	void* data = (layout == PixelLayout::GRAY8 ? static_cast<void*>(gray_pixels) :
+				  layout == PixelLayout::BGRA8 ? static_cast<void*>(packed_pixels) :
+				  layout == PixelLayout::RGBA_F32 ? static_cast<void*>(pixels) : static_cast<void*>(planes));
+	return ImageView(data, get_width(), get_height(), layout);
+}
+
+bool TGA::is_mono() const
+{
+	return get_image_type() == TGAImageType::MONO || get_image_type() == TGAImageType::MONO_RLE;
+}
+
+bool TGA::is_rle() const
+{
+	return get_image_type() == TGAImageType::TRUE_COLOR_RLE || get_image_type() == TGAImageType::MONO_RLE;
+}
+
+void TGA::blur(float factor, int threads, BlurMode mode)
+{
+	if (mode == BlurMode::APPROXIMATE)
+	{
+		blur_image_approximate(get_view(), factor, tolerance, threads, stats, workspace);
+		return;
+	}
+	blur_image(get_view(), factor, threads, mode, stats, workspace);
+}
+
+void TGA::blur_multi(const std::vector<float>& factors, const std::vector<std::string>& out_paths, int threads,
+					 BlurMode mode)
+{
+	if (factors.size() != out_paths.size())
+	{
+		throw std::invalid_argument("Every blur factor needs an output path");
+	}
+	if (threads < 1)
+	{
+		throw std::invalid_argument("Invalid thread count (it needs to be at least 1)");
+	}
+
+	// Outputs are blurred and written a round at a time (as many as the threads writing them), reusing the same
+	// images. The SAT mode makes them all in one round instead, so that they all come from a single table.
+	const size_t count = factors.size();
+	const size_t round_size = (mode == BlurMode::SAT ? count : std::min<size_t>(threads, count));
+	std::vector<std::unique_ptr<TGA>> outputs;
+	std::vector<ImageView> views;
+	for (size_t k = 0; k < round_size; k++)
+	{
+		outputs.emplace_back(new TGA(engine));
+		outputs.back()->copy_header_from(*this);
+		views.push_back(outputs.back()->get_view());
+	}
+
+	for (size_t first = 0; first < count; first += round_size)
+	{
+		const size_t round_count = std::min(round_size, count - first);
+		const std::vector<float> round_factors(factors.begin() + first, factors.begin() + first + round_count);
+		if (mode == BlurMode::APPROXIMATE)
 		{
-			int mirr_i = 0;
-			if (i < pad)
-			{
-				// Top pad
-				mirr_i = pad - i;
-			}
-			else if (i < pad + image_height)
-			{
-				// Middle
-				mirr_i = i - pad;
-			}
-			else
+			// Every factor downsamples at a scale of its own, and the tolerance has to go through
+			for (size_t k = 0; k < round_count; k++)
 			{
-				// Bottom pad
-				mirr_i = image_height - 1 - (i - (pad + image_height) + 1);
+				outputs[k]->copy_from(*this);
+				blur_image_approximate(views[k], round_factors[k], tolerance, threads, stats, workspace);
 			}
-			for (int j = 0; j < padded_img_width; j++)
+		}
+		else
+		{
+			blur_image_multi(get_view(), std::vector<ImageView>(views.begin(), views.begin() + round_count), round_factors,
+							 threads, mode, stats, workspace);
+		}
+
+		// Every output is encoded and written by one of the threads, the ones left over help with the conversions
+		ScopedTimer timer(stats ? &stats->write : nullptr);
+		const int writers = std::max(1, std::min(threads, static_cast<int>(round_count)));
+		std::atomic<size_t> next_output(0);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		auto writer = [&]()
+		{
+			for (size_t k = next_output++; k < round_count; k = next_output++)
 			{
-				int mirr_j = 0;
-				if (j < pad)
+				try
 				{
-					// Left pad
-					mirr_j = pad - j;
+					outputs[k]->set_threads(threads / writers);
+					outputs[k]->write(out_paths[first + k]);
 				}
-				else if (j < pad + image_width)
+				catch (...)
 				{
-					// Middle
-					mirr_j = j - pad;
-				}
-				else
-				{
-					// Right pad
-					mirr_j = image_width - 1 - (j - (pad + image_width) + 1);
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+					{
+						error = std::current_exception();
+					}
 				}
-
-				padded_img[i * padded_img_width + j] = pixels[mirr_i * image_width + mirr_j];
+			}
+		};
+		std::vector<std::thread> pool;
+		pool.reserve(writers - 1);
+		for (int w = 1; w < writers; w++)
+		{
+			pool.emplace_back(writer);
+		}
+		// The calling thread is one of the writers
+		writer();
+		for (std::thread& t : pool)
+		{
+			t.join();
+		}
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+		if (stats)
+		{
+			for (size_t k = 0; k < round_count; k++)
+			{
+				stats->file_bytes += outputs[k]->get_max_output_size();
 			}
 		}
 	}
-	return padded_img;
+}
+
+void TGA::blur(const BlurRect& roi, float factor, int threads, BlurMode mode)
+{
+	if (roi.x < 0 || roi.y < 0 || roi.width < 0 || roi.height < 0 ||
+		roi.x + roi.width > get_width() || roi.y + roi.height > get_height())
+	{
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "Region %d,%d,%d,%d is not inside the %dx%d image",
+				 roi.x, roi.y, roi.width, roi.height, get_width(), get_height());
+		throw std::invalid_argument(buffer);
+	}
+
+	// Rows and columns are in memory in the file order
+	BlurRect stored_roi = roi;
+	if (vert_orient == TGAVertOrientation::BOTTOM_UP)
+	{
+		stored_roi.y = get_height() - roi.y - roi.height;
+	}
+	if (horiz_orient == TGAHorizOrientation::RIGHT_TO_LEFT)
+	{
+		stored_roi.x = get_width() - roi.x - roi.width;
+	}
+	blur_image(get_view(), stored_roi, factor, threads, mode, stats, workspace);
+}
+
+// Standard input/output in binary mode, Windows would translate the line endings otherwise
+static std::istream& open_standard_input()
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	return std::cin;
+}
+
+static std::ostream& open_standard_output()
+{
+#ifdef _WIN32
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+	return std::cout;
 }
 
 void TGA::parse(const std::string& path)
 {
+	ScopedTimer timer(stats ? &stats->parse : nullptr);
+
+	if (path == STANDARD_STREAM)
+	{
+		// The size of a pipe isn't known before reading it all
+		std::vector<uint8_t> in_buffer;
+		std::istream& is = open_standard_input();
+		while (is)
+		{
+			const size_t size = in_buffer.size();
+			in_buffer.resize(std::max<size_t>(2 * size, 1 << 16));
+			is.read(reinterpret_cast<char*>(in_buffer.data() + size), static_cast<std::streamsize>(in_buffer.size() - size));
+			in_buffer.resize(size + static_cast<size_t>(is.gcount()));
+		}
+		if (is.bad())
+		{
+			throw std::ios_base::failure("Unable to read the standard input");
+		}
+		buffer_size = in_buffer.size();
+		if (stats)
+		{
+			stats->file_bytes += buffer_size;
+		}
+		parse(in_buffer.data());
+		return;
+	}
+
+	// Pixels are decoded straight from the mapped file when possible, reading it in a buffer is the fallback
+	MappedFile mapped(path, MappedFile::Mode::READ);
+	if (mapped.is_mapped())
+	{
+		buffer_size = mapped.get_size();
+		if (stats)
+		{
+			stats->file_bytes += buffer_size;
+		}
+		parse(mapped.get_data());
+		return;
+	}
+
 	std::ifstream ifs(path, std::ios::binary | std::ios::ate);
 	if (ifs.fail())
 	{
@@ -181,24 +405,75 @@ void TGA::parse(const std::string& path)
 	else
 	{
 		// The file is open with the ios::ate flag, so this call will directly obtain the size of the file
-		buffer_size = static_cast<int>(ifs.tellg());
+		buffer_size = static_cast<size_t>(ifs.tellg());
 		// We can now use the size to allocate a buffer into which we'll store the file data
-		in_buffer = new uint8_t[buffer_size];
+		std::vector<uint8_t> in_buffer(buffer_size);
+		if (stats)
+		{
+			stats->file_bytes += buffer_size;
+		}
 		ifs.seekg(0, std::ios::beg);
-		ifs.read(reinterpret_cast<char*>(in_buffer), buffer_size);
+		ifs.read(reinterpret_cast<char*>(in_buffer.data()), buffer_size);
 		ifs.close();
 
-		// The order of these 3 function calls is mandatory
-		parse_footer();
-		parse_header();
-		parse_data();
+		parse(in_buffer.data());
+	}
+}
 
-		delete[] in_buffer;
+void TGA::parse(const uint8_t* data)
+{
+	if (buffer_size < 18)
+	{
+		throw std::domain_error("File too short for a TGA header, cannot complete read operation");
 	}
+
+	// The order of these 3 function calls is mandatory
+	parse_footer(data, buffer_size);
+	parse_header(data);
+	if (stats)
+	{
+		stats->width = static_cast<int>(header.image_width);
+		stats->height = static_cast<int>(header.image_height);
+	}
+	parse_data(data, buffer_size);
 }
 
 void TGA::write(const std::string& path)
 {
+	ScopedTimer timer(stats ? &stats->write : nullptr);
+
+	// Pixels are encoded straight into the mapped output file when possible, otherwise in a buffer written after.
+	// Run-length encoded images are laid out for their worst case size and cut to the real one at the end.
+	const size_t max_size = get_max_output_size();
+	if (stats)
+	{
+		stats->file_bytes += max_size;
+	}
+	if (path == STANDARD_STREAM)
+	{
+		std::vector<uint8_t> out_buffer(max_size);
+		const size_t size = write(out_buffer.data());
+
+		std::ostream& os = open_standard_output();
+		os.write(reinterpret_cast<char*>(out_buffer.data()), size);
+		os.flush();
+		if (os.fail())
+		{
+			throw std::ios_base::failure("Unable to write the standard output");
+		}
+		return;
+	}
+	MappedFile mapped(path, MappedFile::Mode::READ_WRITE, max_size);
+	if (mapped.is_mapped())
+	{
+		// Run-length encoded images need the file cut to their size, or the footer wouldn't be at the end anymore
+		if (!mapped.truncate(write(mapped.get_data())))
+		{
+			throw std::ios_base::failure("Unable to cut the file to its size");
+		}
+		return;
+	}
+
 	std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
 	if (ofs.fail())
 	{
@@ -206,188 +481,504 @@ void TGA::write(const std::string& path)
 	}
 	else
 	{
-		out_buffer = new uint8_t[buffer_size];
+		std::vector<uint8_t> out_buffer(max_size);
+		const size_t size = write(out_buffer.data());
 
-		// The order of these 3 function calls is NOT mandatory
-		write_header();
-		write_data();
-		write_footer();
-
-		ofs.write(reinterpret_cast<char*>(out_buffer), buffer_size);
+		ofs.write(reinterpret_cast<char*>(out_buffer.data()), size);
 		ofs.close();
+		if (ofs.fail())
+		{
+			throw std::ios_base::failure("Unable to write the file");
+		}
+	}
+}
 
-		delete[] out_buffer;
+size_t TGA::write(uint8_t* data) const
+{
+	if (is_rle())
+	{
+		// The footer goes right after the compressed data
+		const size_t footer_size = (format == TGAFormat::NEW ? 26 : 0);
+		const size_t capacity = get_max_output_size() - get_data_offset() - footer_size;
+		write_header(data);
+		const size_t size = get_data_offset() + write_rle_data(data + get_data_offset(), capacity) + footer_size;
+		write_footer(data, size);
+		return size;
 	}
+
+	// The order of these 3 function calls is NOT mandatory
+	write_header(data);
+	write_data(data);
+	write_footer(data, buffer_size);
+	return buffer_size;
 }
 
-void TGA::blur(float factor)
+size_t TGA::get_max_output_size() const
 {
-	if (factor < 0.f || factor > 1.f)
+	if (is_rle())
 	{
-		throw std::invalid_argument("Invalid blur factor (it needs to be in the 0 < f < 1 range)");
+		// Every row all in raw packets, one header byte every 128 pixels (encode_rle_row() never needs more)
+		const size_t image_width = header.image_width;
+		const size_t row_size = image_width * (header.pixel_depth / 8) + (image_width + 127) / 128;
+		return get_data_offset() + row_size * header.image_height + (format == TGAFormat::NEW ? 26 : 0);
 	}
-	
-	// Linear interpolation between 0 < x < 1 and 0 < y < min(image_height, image_width) / 2
-	const int image_height = static_cast<int>(header.image_height);
-	const int image_width = static_cast<int>(header.image_width);
-	const int max_kernel_size = std::min(image_height, image_width) / 2;
-	int kernel_size = static_cast<int>(round(max_kernel_size * factor));
+	return buffer_size;
+}
+
+// Rows are read and written STREAM_STRIP_ROWS at a time
+static const int STREAM_STRIP_ROWS = 64;
+
+// Conversions between the pixels of the file (BGR or BGRA bytes) and the ones in memory. They're compiled once for
+// each pixel size, the callers pick one per image (or per row) so the loops have no per pixel test: 24 bit pixels
+// never read nor write an alpha byte. Orientation doesn't matter here, pixels are kept in the file order. The float
+// ones are the vector kernels of the blur library.
+template <int BytesPerPixel>
+static void decode_pixels(const uint8_t* src, RGBA* dst, const size_t count)
+{
+	decode_bgr_pixels(src, dst, count, BytesPerPixel);
+}
 
-	if (kernel_size % 2 == 0)
+template <int BytesPerPixel>
+static void encode_pixels(const RGBA* src, uint8_t* dst, const size_t count)
+{
+	encode_bgr_pixels(src, dst, count, BytesPerPixel);
+}
+
+// The integer engine counterparts, BGRA bytes in the file order with an opaque alpha for 24 bit pixels: 32 bit
+// pixels are a plain copy
+template <int BytesPerPixel>
+static void decode_pixels(const uint8_t* src, uint32_t* dst, const size_t count)
+{
+	if (BytesPerPixel == 4)
 	{
-		// Having only odd values is required
-		kernel_size--;
+		memcpy(dst, src, count * sizeof(uint32_t));
+		return;
 	}
+	// Whole words are copied (the 4th byte is the first of the next pixel, replaced by the alpha right after),
+	// but for the last pixel which could be the last bytes of the data
+	uint8_t* dst_bytes = reinterpret_cast<uint8_t*>(dst);
+	for (size_t j = 0; j + 1 < count; j++)
+	{
+		memcpy(dst + j, src + BytesPerPixel * j, sizeof(uint32_t));
+		dst_bytes[4 * j + 3] = 0xFF;
+	}
+	if (count > 0)
+	{
+		memcpy(dst + count - 1, src + BytesPerPixel * (count - 1), BytesPerPixel);
+		dst_bytes[4 * count - 1] = 0xFF;
+	}
+}
 
-	if (kernel_size <= 0)
+template <int BytesPerPixel>
+static void encode_pixels(const uint32_t* src, uint8_t* dst, const size_t count)
+{
+	if (BytesPerPixel == 4)
 	{
+		memcpy(dst, src, count * sizeof(uint32_t));
 		return;
 	}
+	// Same trick, every word written overlaps the next pixel by a byte which the next one overwrites
+	for (size_t j = 0; j + 1 < count; j++)
+	{
+		memcpy(dst + BytesPerPixel * j, src + j, sizeof(uint32_t));
+	}
+	if (count > 0)
+	{
+		memcpy(dst + BytesPerPixel * (count - 1), src + count - 1, BytesPerPixel);
+	}
+}
+
+// Mono images are kept as they are in the file, a gray byte per pixel whatever the engine
+template <int BytesPerPixel>
+static void decode_pixels(const uint8_t* src, uint8_t* dst, const size_t count)
+{
+	static_assert(BytesPerPixel == 1, "Gray pixels are a single byte");
+	memcpy(dst, src, count);
+}
+
+template <int BytesPerPixel>
+static void encode_pixels(const uint8_t* src, uint8_t* dst, const size_t count)
+{
+	static_assert(BytesPerPixel == 1, "Gray pixels are a single byte");
+	memcpy(dst, src, count);
+}
+
+// The planar engine ones, on the pixels from data of count planes of plane_size floats each (adding to it moves
+// along all the planes at once)
+struct Planes
+{
+	Planes operator + (const size_t offset) const { return { data + offset, plane_size, count }; }
+
+	float* data;
+	size_t plane_size;
+	int count;
+};
+
+template <int BytesPerPixel>
+static void decode_pixels(const uint8_t* src, const Planes& dst, const size_t count)
+{
+	decode_bgr_planes(src, dst.data, dst.plane_size, count, BytesPerPixel);
+}
+
+template <int BytesPerPixel>
+static void encode_pixels(const Planes& src, uint8_t* dst, const size_t count)
+{
+	encode_bgr_planes(src.data, src.plane_size, dst, count, BytesPerPixel);
+}
+
+template <typename Pixels>
+static void decode_pixels(const uint8_t* src, const Pixels& dst, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? decode_pixels<4>(src, dst, count) : decode_pixels<3>(src, dst, count);
+}
+
+template <typename Pixels>
+static void encode_pixels(const Pixels& src, uint8_t* dst, const size_t count, const int bytes_per_pixel)
+{
+	bytes_per_pixel == 4 ? encode_pixels<4>(src, dst, count) : encode_pixels<3>(src, dst, count);
+}
+
+// Copies the first of count pixels over the others, for run-length packets
+template <typename Pixel>
+static void fill_run(Pixel* pixels, const size_t count)
+{
+	std::fill(pixels + 1, pixels + count, pixels[0]);
+}
+
+static void fill_run(const Planes& pixels, const size_t count)
+{
+	for (int p = 0; p < pixels.count; p++)
+	{
+		float* plane = pixels.data + p * pixels.plane_size;
+		std::fill(plane + 1, plane + count, plane[0]);
+	}
+}
+
+// Expands the run-length packets of data into pixel_count pixels. Packets are expanded straight into the pixel
+// buffer, in file order like the raw data. They're not supposed to span rows but some encoders do, so they're
+// allowed to.
+template <int BytesPerPixel, typename Pixels>
+static void decode_rle_pixels(const uint8_t* data, const size_t size, const Pixels& pixels, const size_t pixel_count)
+{
+	size_t pos = 0;
+	for (size_t i = 0; i < pixel_count;)
+	{
+		if (pos >= size)
+		{
+			throw std::domain_error("Truncated image data, cannot complete read operation");
+		}
+		const uint8_t packet = data[pos++];
+		const bool run = (packet & 0x80) != 0;
+		const size_t count = static_cast<size_t>(packet & 0x7F) + 1;
+		const size_t packet_size = (run ? 1 : count) * BytesPerPixel;
+		if (count > pixel_count - i)
+		{
+			throw std::domain_error("Run-length packet past the end of the image, cannot complete read operation");
+		}
+		if (packet_size > size - pos)
+		{
+			throw std::domain_error("Truncated image data, cannot complete read operation");
+		}
 
-	const int pad = static_cast<int>(std::floor(kernel_size / 2));
-	RGBA* padded_img = get_mirror_padded_image(pad);
+		decode_pixels<BytesPerPixel>(data + pos, pixels + i, run ? 1 : count);
+		if (run)
+		{
+			fill_run(pixels + i, count);
+		}
+		i += count;
+		pos += packet_size;
+	}
+}
 
-	/* Trivial unoptimized box blur algorithm version, for sanity checking
-	const int padded_img_height = image_height + 2 * pad;
-	const int padded_img_width = image_width + 2 * pad;
-	if (padded_img && pixels)
+// Packs a row of width pixels (already in the file format) into dst, returns the end of the packets. Packets
+// never span rows. A run packet needs 2 equal pixels, or 3 for 1 byte pixels (a run of 2 gray bytes is no smaller
+// than the raw packet it would split), so a row never takes more than its raw packets would: that's the size
+// get_max_output_size() lays out, and going past dst_end anyway throws.
+template <int BytesPerPixel>
+static uint8_t* encode_rle_row(const uint8_t* row, const int width, uint8_t* dst, const uint8_t* dst_end)
+{
+	const int min_run = (BytesPerPixel > 1 ? 2 : 3);
+	auto is_equal = [](const uint8_t* lhs, const uint8_t* rhs) { return memcmp(lhs, rhs, BytesPerPixel) == 0; };
+	auto starts_run = [&](const int j)
 	{
-		for (int i = 0; i < image_height; i++)
+		const uint8_t* src = row + static_cast<ptrdiff_t>(j) * BytesPerPixel;
+		if (j + min_run > width)
+		{
+			return false;
+		}
+		for (int k = 1; k < min_run; k++)
 		{
-			for (int j = 0; j < image_width; j++)
+			if (!is_equal(src, src + k * BytesPerPixel))
 			{
-				RGBA sum = RGBA(0.f, 1.f);
-				for (int ii = pad + i - (pad - 1); ii < i + kernel_size; ii++)
-				{
-					for (int jj = pad + j - (pad - 1); jj < j + kernel_size; jj++)
-					{
-						sum += padded_img[ii * padded_img_width + jj];
-					}
-				}
-				sum /= RGBA(kernel_size * kernel_size, 1.f);
-				pixels[i * image_width + j] = sum;
+				return false;
 			}
 		}
-	}*/
-
-	// Box blur with separated filter (spanning rows and columns separately) and moving average optimization
-	const int padded_img_height = image_height + 2 * pad;
-	const int padded_img_width = image_width + 2 * pad;
-	RGBA* tmp = new RGBA[padded_img_height * padded_img_width];
-	std::copy(padded_img, padded_img + (padded_img_height * padded_img_width), tmp);
-	for (int i = 0; i < padded_img_height; i++) // Row index
+		return true;
+	};
+	auto reserve = [&](const size_t size)
 	{
-		int j = pad; // Col index
-
-		// Initialize sum and fill the buffer for the first time before using the moving average
-		RGBA sum = RGBA(0.f, 1.f);
-		int k = 0;
-		while (k <= j + pad)
+		if (static_cast<size_t>(dst_end - dst) < size)
 		{
-			sum += padded_img[i * padded_img_width + k];
-			k++;
+			throw std::length_error("Run-length encoded data past its worst case size, cannot complete write operation");
 		}
+	};
 
-		tmp[i * padded_img_width + j] = sum / RGBA(kernel_size, 1.f);
-		j++;
-
-		while (j < image_width + pad)
+	for (int j = 0; j < width;)
+	{
+		const uint8_t* src = row + static_cast<ptrdiff_t>(j) * BytesPerPixel;
+		int count = 1;
+		if (starts_run(j))
 		{
-			// Moving average
-			sum += padded_img[i * padded_img_width + k];
-			sum -= padded_img[i * padded_img_width + (k - kernel_size)];
-			tmp[i * padded_img_width + j] = sum / RGBA(kernel_size, 1.f);
+			while (j + count < width && count < 128 && is_equal(src, src + count * BytesPerPixel))
+			{
+				count++;
+			}
+			// Run packet, one pixel repeated count times
+			reserve(1 + BytesPerPixel);
+			*dst++ = static_cast<uint8_t>(0x80 | (count - 1));
+			memcpy(dst, src, BytesPerPixel);
+			dst += BytesPerPixel;
+			j += count;
+			continue;
+		}
 
-			k++;
-			j++;
+		// Raw packet, up to the next pixels a run packet starts from
+		while (j + count < width && count < 128 && !starts_run(j + count))
+		{
+			count++;
 		}
+		reserve(1 + static_cast<size_t>(count) * BytesPerPixel);
+		*dst++ = static_cast<uint8_t>(count - 1);
+		memcpy(dst, src, static_cast<size_t>(count) * BytesPerPixel);
+		dst += count * BytesPerPixel;
+		j += count;
 	}
+	return dst;
+}
 
-	for (int i = pad; i < image_width + pad; i++) // Col index
+// Copies size bytes (or everything up to the end of the input when size is negative) from is to os, a chunk at a
+// time, returns how many it copied
+static long long copy_bytes(std::istream& is, std::ostream& os, long long size, std::vector<uint8_t>& chunk)
+{
+	long long copied = 0;
+	while (size != 0 && is)
 	{
-		int j = pad; // Row index
-
-		// Initialize sum and fill the buffer for the first time before using the moving average
-		RGBA sum = RGBA(0.f, 1.f);
-		int k = 0;
-		while (k <= j + pad)
+		const long long wanted = (size < 0 ? static_cast<long long>(chunk.size()) : std::min<long long>(size, chunk.size()));
+		is.read(reinterpret_cast<char*>(chunk.data()), static_cast<std::streamsize>(wanted));
+		const std::streamsize count = is.gcount();
+		os.write(reinterpret_cast<const char*>(chunk.data()), count);
+		copied += count;
+		if (size > 0)
 		{
-			sum += tmp[k * padded_img_width + i];
-			k++;
+			size -= count;
 		}
+	}
+	return copied;
+}
 
-		// Updating source pixel values
-		pixels[(j - pad) * image_width + (i - pad)] = sum / RGBA(kernel_size, 1.f);
-		j++;
+// Blurs height rows of width pixels from is to os, in file order, a strip of rows at a time. Returns false when
+// the input ends before the first row (nothing is written then), and throws when it ends in the middle.
+static bool stream_rows(std::istream& is, std::ostream& os, const int width, const int height, const int bytes_per_pixel,
+						const int kernel_size, std::vector<uint8_t>& in_strip, std::vector<uint8_t>& out_strip,
+						BlurStats* stats)
+{
+	const int row_size = width * bytes_per_pixel;
+	in_strip.resize(static_cast<size_t>(STREAM_STRIP_ROWS) * row_size);
+	out_strip.resize(in_strip.size());
 
-		while (j < image_height + pad)
+	std::vector<RGBA> row(width);
+	int out_rows = 0;
+	const StreamBlur::RowCallback emit = [&](const RGBA* blurred)
+	{
+		encode_pixels(blurred, out_strip.data() + static_cast<ptrdiff_t>(out_rows) * row_size, width, bytes_per_pixel);
+		if (++out_rows == STREAM_STRIP_ROWS)
 		{
-			// Moving average
-			sum += tmp[k * padded_img_width + i];
-			sum -= tmp[(k - kernel_size) * padded_img_width + i];
-			// Updating source pixel values
-			pixels[(j - pad) * image_width + (i - pad)] = sum / RGBA(kernel_size, 1.f);
-
-			k++;
-			j++;
+			os.write(reinterpret_cast<const char*>(out_strip.data()), static_cast<std::streamsize>(out_rows) * row_size);
+			out_rows = 0;
 		}
-	}
+	};
 
-	//Box blur with precomputed SAT (Summed Area Table) optimization (I've not been able to make it work 100%)
-	/*if (padded_img && pixels)
+	StreamBlur stream(width, height, kernel_size);
+	if (stats)
 	{
-		// Summed Area Table algorithm (using dynamic programming)
-		const int image_height = static_cast<int>(header.image_height);
-		const int image_width = static_cast<int>(header.image_width);
-		const int padded_img_height = image_height + 2 * pad;
-		const int padded_img_width = image_width + 2 * pad;
-		for (int i = 0; i < padded_img_height; i++)
+		stats->scratch_bytes = std::max(stats->scratch_bytes, stream.get_scratch_bytes() + in_strip.size() +
+																   out_strip.size() + row.size() * sizeof(RGBA));
+	}
+	for (int i = 0; i < height; i += STREAM_STRIP_ROWS)
+	{
+		const int rows = std::min(STREAM_STRIP_ROWS, height - i);
+		const std::streamsize size = static_cast<std::streamsize>(rows) * row_size;
+		is.read(reinterpret_cast<char*>(in_strip.data()), size);
+		if (is.gcount() != size)
 		{
-			for (int j = 0; j < padded_img_width; j++)
+			if (i == 0 && is.gcount() == 0)
 			{
-				if (i > 0 && j > 0)
-				{
- 					padded_img[i * padded_img_width + j] = padded_img[i * padded_img_width + j] +
- 														   padded_img[(i - 1) * padded_img_width + j] +
- 														   padded_img[i * padded_img_width + (j - 1)] -
- 														   padded_img[(i - 1) * padded_img_width + (j - 1)];
-				}
-				else if (i > 0 && j == 0)
-				{
- 					padded_img[i * padded_img_width + j] = padded_img[i * padded_img_width + j] +
- 														   padded_img[(i - 1) * padded_img_width + j];
-				}
-				else if (j > 0 && i == 0)
-				{
- 					padded_img[i * padded_img_width + j] = padded_img[i * padded_img_width + j] +
- 														   padded_img[i * padded_img_width + (j - 1)];
-				}
-				else
-				{
-					padded_img[i * padded_img_width + j] = padded_img[i * padded_img_width + j];
-				}
+				return false;
 			}
+			throw std::domain_error("Truncated image data, cannot complete read operation");
 		}
+		for (int r = 0; r < rows; r++)
+		{
+			decode_pixels(in_strip.data() + static_cast<ptrdiff_t>(r) * row_size, row.data(), width, bytes_per_pixel);
+			stream.push_row(row.data(), emit);
+		}
+	}
+	os.write(reinterpret_cast<const char*>(out_strip.data()), static_cast<std::streamsize>(out_rows) * row_size);
+	if (stats)
+	{
+		stats->file_bytes += 2 * static_cast<size_t>(row_size) * height;
+	}
+	return true;
+}
 
-		// Filtering the image using a constant value (of 1) kernel
-		for (int i = 0, ii = pad; i < image_height; i++, ii++)
+void TGA::blur_stream(const std::string& in_path, const std::string& out_path, float factor, BlurStats* stats)
+{
+	std::ifstream ifs;
+	std::ofstream ofs;
+	if (in_path != STANDARD_STREAM)
+	{
+		ifs.open(in_path, std::ios::binary);
+		if (ifs.fail())
 		{
-			for (int j = 0, jj = pad; j < image_width; j++, jj++)
-			{
-				const int bottom_right = (ii + pad - 1) * padded_img_width + (jj + pad - 1);
-				const int top_left = (ii - pad) * padded_img_width + (jj - pad);
-				const int bottom_left = (ii + pad - 1) * padded_img_width + (jj - pad);
-				const int top_right = (ii - pad) * padded_img_width + (jj + pad - 1);
- 				pixels[i * image_width + j] = padded_img[bottom_right] + padded_img[top_left] -
- 											  padded_img[bottom_left] -	padded_img[top_right];
-				pixels[i * image_width + j] /= RGBA(kernel_size * kernel_size, 1.f);
-			}
+			throw std::ios_base::failure("Unable to open file for reading");
+		}
+	}
+	if (out_path != STANDARD_STREAM)
+	{
+		ofs.open(out_path, std::ios::binary | std::ios::trunc);
+		if (ofs.fail())
+		{
+			throw std::ios_base::failure("Unable to open file for writing");
+		}
+	}
+	blur_stream(in_path == STANDARD_STREAM ? open_standard_input() : ifs,
+				out_path == STANDARD_STREAM ? open_standard_output() : ofs, factor, stats);
+}
+
+void TGA::blur_stream(std::istream& is, std::ostream& os, float factor, BlurStats* stats)
+{
+	// Reading, blurring and writing are interleaved here, it all goes in the blur time
+	ScopedTimer timer(stats ? &stats->blur : nullptr);
+
+	// The input is read once from start to end, it may be a pipe: the header is all that's needed upfront, the
+	// footer (wherever it is) goes through with the rest of the bytes after the image data
+	TGA image(BlurEngine::FLOAT);
+	uint8_t header_bytes[18] = {};
+	is.read(reinterpret_cast<char*>(header_bytes), sizeof(header_bytes));
+	if (is.gcount() != sizeof(header_bytes))
+	{
+		throw std::domain_error("File too short for a TGA header, cannot complete read operation");
+	}
+	image.parse_footer(nullptr, 0);
+	image.parse_header(header_bytes);
+	if (image.get_image_type() != TGAImageType::TRUE_COLOR)
+	{
+		throw std::domain_error("Only uncompressed true color images can be streamed");
+	}
+
+	const int image_width = static_cast<int>(image.header.image_width);
+	const int image_height = static_cast<int>(image.header.image_height);
+	const int bytes_per_pixel = image.header.pixel_depth / 8;
+	const int kernel_size = image.get_kernel_size(factor);
+	if (stats)
+	{
+		stats->width = image_width;
+		stats->height = image_height;
+		stats->kernel_size = std::max(0, kernel_size);
+		stats->pad = std::max(0, kernel_size) / 2;
+	}
+
+	// Header as write() would produce it, the image id, color map, extension area and footer are copied as they are
+	uint8_t out_header[18] = {};
+	image.write_header(out_header);
+	os.write(reinterpret_cast<const char*>(out_header), sizeof(out_header));
+
+	// Rows go through in file order whatever the orientation: in memory they are stored that way too, and the
+	// box filter is symmetric, so a bottom-up image blurs exactly like its top-down version
+	std::vector<uint8_t> in_strip(static_cast<size_t>(STREAM_STRIP_ROWS) * image_width * bytes_per_pixel);
+	std::vector<uint8_t> out_strip;
+	const long long skipped = image.get_data_offset() - static_cast<long long>(sizeof(header_bytes));
+	long long copied = copy_bytes(is, os, skipped, in_strip);
+	if (copied != skipped ||
+		!stream_rows(is, os, image_width, image_height, bytes_per_pixel, kernel_size, in_strip, out_strip, stats))
+	{
+		throw std::domain_error("Truncated image data, cannot complete read operation");
+	}
+	copied += copy_bytes(is, os, -1, in_strip);
+	if (stats)
+	{
+		stats->file_bytes += 2 * (sizeof(header_bytes) + static_cast<size_t>(copied));
+	}
+
+	os.flush();
+	if (is.bad() || os.fail())
+	{
+		throw std::ios_base::failure("Error while streaming the image");
+	}
+}
+
+void blur_raw_stream(const std::string& in_path, const std::string& out_path, const RawFormat& format, float factor,
+					 BlurStats* stats)
+{
+	if (format.width <= 0 || format.height <= 0 || (format.channels != 3 && format.channels != 4))
+	{
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "Invalid raw format %dx%dx%d (3 or 4 channels)",
+				 format.width, format.height, format.channels);
+		throw std::invalid_argument(buffer);
+	}
+	ScopedTimer timer(stats ? &stats->blur : nullptr);
+
+	std::ifstream ifs;
+	std::ofstream ofs;
+	if (in_path != TGA::STANDARD_STREAM)
+	{
+		ifs.open(in_path, std::ios::binary);
+		if (ifs.fail())
+		{
+			throw std::ios_base::failure("Unable to open file for reading");
+		}
+	}
+	if (out_path != TGA::STANDARD_STREAM)
+	{
+		ofs.open(out_path, std::ios::binary | std::ios::trunc);
+		if (ofs.fail())
+		{
+			throw std::ios_base::failure("Unable to open file for writing");
 		}
-	}*/
+	}
+	std::istream& is = (in_path == TGA::STANDARD_STREAM ? open_standard_input() : ifs);
+	std::ostream& os = (out_path == TGA::STANDARD_STREAM ? open_standard_output() : ofs);
 
-	delete[] padded_img;
+	const int kernel_size = get_blur_kernel_size(format.width, format.height, factor);
+	if (stats)
+	{
+		stats->width = format.width;
+		stats->height = format.height;
+		stats->kernel_size = std::max(0, kernel_size);
+		stats->pad = std::max(0, kernel_size) / 2;
+	}
+	// Frames follow one another until the input ends, the strips are kept from one to the next
+	std::vector<uint8_t> in_strip, out_strip;
+	int frames = 0;
+	while (stream_rows(is, os, format.width, format.height, format.channels, kernel_size, in_strip, out_strip, stats))
+	{
+		frames++;
+	}
+	if (frames == 0)
+	{
+		throw std::domain_error("Empty input, no frame to blur");
+	}
+
+	os.flush();
+	if (is.bad() || os.fail())
+	{
+		throw std::ios_base::failure("Error while streaming the image");
+	}
 }
 
+
+const std::string TGA::STANDARD_STREAM               = "-";
 const std::string TGA::SIGNATURE                     = "TRUEVISION-XFILE";
 const int TGA::SIGNATURE_SIZE                        = 16;
 const std::string TGA::TYPE_COLOR_MAPPED_NAME        = "Color mapped";
@@ -397,22 +988,22 @@ const std::string TGA::TYPE_COLOR_MAPPED_RLE_NAME    = "Color mapped run-length
 const std::string TGA::TYPE_TRUE_COLOR_RLE_NAME      = "True color run-length encoded";
 const std::string TGA::TYPE_BLACK_AND_WHITE_RLE_NAME = "Black and white run-length encoded";
 
-void TGA::parse_header()
+void TGA::parse_header(const uint8_t* data)
 {
-	if (in_buffer)
+	if (data)
 	{
-		header.id_length            = in_buffer[0];
-		header.color_map_type       = in_buffer[1];
-		header.image_type           = in_buffer[2];
-		header.first_entry_index    = static_cast<uint16_t>(in_buffer[3]) | static_cast<uint16_t>(in_buffer[4] << 8);
-		header.color_map_length     = static_cast<uint16_t>(in_buffer[5]) | static_cast<uint16_t>(in_buffer[6] << 8);
-		header.color_map_entry_size = in_buffer[7];
-		header.x_origin             = static_cast<uint16_t>(in_buffer[8]) | static_cast<uint16_t>(in_buffer[9] << 8);
-		header.y_origin             = static_cast<uint16_t>(in_buffer[10]) | static_cast<uint16_t>(in_buffer[11] << 8);
-		header.image_width          = static_cast<uint16_t>(in_buffer[12]) | static_cast<uint16_t>(in_buffer[13] << 8);
-		header.image_height         = static_cast<uint16_t>(in_buffer[14]) | static_cast<uint16_t>(in_buffer[15] << 8);
-		header.pixel_depth          = in_buffer[16];
-		header.image_descriptor     = in_buffer[17];
+		header.id_length            = data[0];
+		header.color_map_type       = data[1];
+		header.image_type           = data[2];
+		header.first_entry_index    = static_cast<uint16_t>(data[3]) | static_cast<uint16_t>(data[4] << 8);
+		header.color_map_length     = static_cast<uint16_t>(data[5]) | static_cast<uint16_t>(data[6] << 8);
+		header.color_map_entry_size = data[7];
+		header.x_origin             = static_cast<uint16_t>(data[8]) | static_cast<uint16_t>(data[9] << 8);
+		header.y_origin             = static_cast<uint16_t>(data[10]) | static_cast<uint16_t>(data[11] << 8);
+		header.image_width          = static_cast<uint16_t>(data[12]) | static_cast<uint16_t>(data[13] << 8);
+		header.image_height         = static_cast<uint16_t>(data[14]) | static_cast<uint16_t>(data[15] << 8);
+		header.pixel_depth          = data[16];
+		header.image_descriptor     = data[17];
 	}
 
 	image_type = static_cast<TGAImageType>(header.image_type);
@@ -436,188 +1027,291 @@ void TGA::parse_header()
 	{
 		throw std::domain_error("Invalid pixel depth value, cannot complete read operation");
 	}
-	if (header.pixel_depth != 24 && header.pixel_depth != 32)
+	if (!is_mono() && get_image_type() != TGAImageType::TRUE_COLOR && get_image_type() != TGAImageType::TRUE_COLOR_RLE)
 	{
 		char buffer[100];
-		sprintf_s(buffer, "%dbit pixel depth images are not currently supported", header.pixel_depth);
+		snprintf(buffer, sizeof(buffer), "%s image type is not currently supported", get_image_type_name().c_str());
 		throw std::domain_error(buffer);
 	}
-	if (get_image_type() != TGAImageType::TRUE_COLOR)
+	// 8 bit gray for mono images, 24 or 32 bit BGR(A) for true color ones
+	if (is_mono() ? header.pixel_depth != 8 : header.pixel_depth != 24 && header.pixel_depth != 32)
 	{
 		char buffer[100];
-		sprintf_s(buffer, "%s image type is not currently supported", get_image_type_name().c_str());
+		snprintf(buffer, sizeof(buffer), "%dbit pixel depth %s images are not currently supported", header.pixel_depth,
+				 get_image_type_name().c_str());
 		throw std::domain_error(buffer);
 	}
 }
 
-void TGA::parse_data()
+void TGA::reserve_pixels(const size_t pixel_count)
 {
-	// Computing the offset (from the start of the file) to the first byte of image data
-	int start_offset = 18; // Starting from the first byte after the header
-	start_offset += static_cast<int>(header.id_length); // Skipping image id field
-	if (header.color_map_type != 0) // Skipping color map data field
+	// 24 bit images don't need an alpha plane, it would only be blurred to be thrown away. Mono images take the
+	// gray buffer whatever the engine, so a color image after a mono one (or the other way round) needs a new one.
+	const PixelLayout layout = get_layout();
+	const size_t capacity = pixel_count * get_pixel_size(layout) * ::get_plane_count(layout);
+	const bool has_buffer = (is_mono() ? gray_pixels != nullptr : engine == BlurEngine::INTEGER ? packed_pixels != nullptr :
+							 engine == BlurEngine::PLANAR ? planes != nullptr : pixels != nullptr);
+	if (capacity > pixels_capacity || !has_buffer)
 	{
-		// When need to ceil to get the right amount of bytes because the number of bits may be 15
-		start_offset += static_cast<int>(header.color_map_length) * 
-						static_cast<int>(ceil(static_cast<int>(header.color_map_entry_size) / 8));
+		delete[] pixels;
+		delete[] packed_pixels;
+		delete[] planes;
+		delete[] gray_pixels;
+		pixels = nullptr;
+		packed_pixels = nullptr;
+		planes = nullptr;
+		gray_pixels = nullptr;
+		if (is_mono())
+		{
+			gray_pixels = new uint8_t[capacity];
+		}
+		else if (engine == BlurEngine::INTEGER)
+		{
+			packed_pixels = new uint32_t[capacity / sizeof(uint32_t)];
+		}
+		else if (engine == BlurEngine::PLANAR)
+		{
+			planes = new float[capacity / sizeof(float)];
+		}
+		else
+		{
+			pixels = new RGBA[capacity / sizeof(RGBA)];
+		}
+		pixels_capacity = capacity;
+		if (stats)
+		{
+			stats->pixel_bytes += capacity;
+		}
 	}
+}
 
-	if (get_image_type() == TGAImageType::TRUE_COLOR)
+int TGA::get_plane_count() const
+{
+	return header.pixel_depth == 32 ? 4 : 3;
+}
+
+void TGA::parse_data(const uint8_t* data, const size_t size)
+{
+	const int start_offset = get_data_offset();
+
+	if (is_mono() || get_image_type() == TGAImageType::TRUE_COLOR || get_image_type() == TGAImageType::TRUE_COLOR_RLE)
 	{
 		const int image_width = static_cast<int>(header.image_width);
 		const int image_height = static_cast<int>(header.image_height);
 		const int bytes_per_pixel = header.pixel_depth / 8;
+		const size_t pixel_count = static_cast<size_t>(image_width) * image_height;
+		const size_t data_size = (!is_rle() ? pixel_count * bytes_per_pixel : 0);
+		if (start_offset + data_size > size)
+		{
+			throw std::domain_error("Truncated image data, cannot complete read operation");
+		}
 
-		pixels = new RGBA[image_width * image_height];
+		reserve_pixels(pixel_count);
 
-		if (in_buffer && pixels)
+		if (is_rle())
 		{
-			int i = (vert_orient == TGAVertOrientation::TOP_DOWN ? 0 : image_height - 1);
-			while (i != (vert_orient == TGAVertOrientation::TOP_DOWN ? image_height : -1))
-			{
-				int j = (horiz_orient == TGAHorizOrientation::LEFT_TO_RIGHT ? 0 : image_width - 1);
-				while (j != (horiz_orient == TGAHorizOrientation::LEFT_TO_RIGHT ? image_width : -1))
-				{
-					const int curr_pixel_offset = start_offset + (i * image_width + j) * bytes_per_pixel;
-					// The order in which the color bytes are displaced is BGRA
-					pixels[i * image_width + j] = RGBA(
-						static_cast<int>(in_buffer[curr_pixel_offset + 2]) / 255.f,
-						static_cast<int>(in_buffer[curr_pixel_offset + 1]) / 255.f,
-						static_cast<int>(in_buffer[curr_pixel_offset]) / 255.f,
-						bytes_per_pixel == 4 ? static_cast<int>(in_buffer[curr_pixel_offset + 3]) / 255.f : 1.f
-					);
-
-					horiz_orient == TGAHorizOrientation::LEFT_TO_RIGHT ? j++ : j--;
-				}
+			parse_rle_data(data + start_offset, size - start_offset);
+			return;
+		}
 
-				vert_orient == TGAVertOrientation::TOP_DOWN ? i++ : i--;
-			}
+		// Pixels stay in the file order whatever the orientation, it's only taken into account when they're
+		// looked at (get_view() users and blur(roi))
+		if (!data)
+		{
+			return;
+		}
+		if (is_mono())
+		{
+			decode_pixels<1>(data + start_offset, gray_pixels, pixel_count);
+		}
+		else if (engine == BlurEngine::INTEGER)
+		{
+			decode_pixels(data + start_offset, packed_pixels, pixel_count, bytes_per_pixel);
+		}
+		else if (engine == BlurEngine::PLANAR)
+		{
+			decode_bgr_planes(data + start_offset, planes, pixel_count, pixel_count, bytes_per_pixel, threads);
+		}
+		else
+		{
+			decode_bgr_pixels(data + start_offset, pixels, pixel_count, bytes_per_pixel, threads);
 		}
 	}
 }
 
-void TGA::parse_footer()
+void TGA::parse_rle_data(const uint8_t* data, const size_t size)
 {
-	if (in_buffer)
+	const int bytes_per_pixel = header.pixel_depth / 8;
+	const size_t pixel_count = static_cast<size_t>(header.image_width) * header.image_height;
+	if (is_mono())
+	{
+		decode_rle_pixels<1>(data, size, gray_pixels, pixel_count);
+	}
+	else if (engine == BlurEngine::INTEGER)
 	{
-		footer.signature = std::string(reinterpret_cast<const char*>(&in_buffer[buffer_size - 18]), SIGNATURE_SIZE);
+		bytes_per_pixel == 4 ? decode_rle_pixels<4>(data, size, packed_pixels, pixel_count)
+							 : decode_rle_pixels<3>(data, size, packed_pixels, pixel_count);
+	}
+	else if (engine == BlurEngine::PLANAR)
+	{
+		const Planes pixels = { planes, pixel_count, get_plane_count() };
+		bytes_per_pixel == 4 ? decode_rle_pixels<4>(data, size, pixels, pixel_count)
+							 : decode_rle_pixels<3>(data, size, pixels, pixel_count);
+	}
+	else
+	{
+		bytes_per_pixel == 4 ? decode_rle_pixels<4>(data, size, pixels, pixel_count)
+							 : decode_rle_pixels<3>(data, size, pixels, pixel_count);
+	}
+}
+
+void TGA::parse_footer(const uint8_t* data, const size_t size)
+{
+	// Files too short for the footer can only be in the original format
+	format = TGAFormat::ORIGIN;
+	if (data && size >= 26)
+	{
+		footer.signature = std::string(reinterpret_cast<const char*>(&data[size - 18]), SIGNATURE_SIZE);
 		format = (footer.signature == SIGNATURE ? TGAFormat::NEW : TGAFormat::ORIGIN);
 		if (format == TGAFormat::NEW)
 		{
-			footer.ext_area_offset = static_cast<uint32_t>(in_buffer[buffer_size - 26])
-				                   | static_cast<uint32_t>(in_buffer[buffer_size - 25] << 8)
-				                   | static_cast<uint32_t>(in_buffer[buffer_size - 24] << 16)
-				                   | static_cast<uint32_t>(in_buffer[buffer_size - 23] << 24);
-			footer.dev_dir_offset  = static_cast<uint32_t>(in_buffer[buffer_size - 22])
-				                   | static_cast<uint32_t>(in_buffer[buffer_size - 21] << 8)
-				                   | static_cast<uint32_t>(in_buffer[buffer_size - 20] << 16)
-				                   | static_cast<uint32_t>(in_buffer[buffer_size - 19] << 24);
+			footer.ext_area_offset = static_cast<uint32_t>(data[size - 26])
+				                   | static_cast<uint32_t>(data[size - 25] << 8)
+				                   | static_cast<uint32_t>(data[size - 24] << 16)
+				                   | static_cast<uint32_t>(data[size - 23] << 24);
+			footer.dev_dir_offset  = static_cast<uint32_t>(data[size - 22])
+				                   | static_cast<uint32_t>(data[size - 21] << 8)
+				                   | static_cast<uint32_t>(data[size - 20] << 16)
+				                   | static_cast<uint32_t>(data[size - 19] << 24);
 		}
 	}
 }
 
-void TGA::write_header()
+void TGA::write_header(uint8_t* data) const
 {
-	if (out_buffer)
+	if (data)
 	{
-		out_buffer[0] = header.id_length;
-		if (get_image_type() == TGAImageType::TRUE_COLOR || get_image_type() == TGAImageType::TRUE_COLOR_RLE)
+		data[0] = header.id_length;
+		if (is_mono() || get_image_type() == TGAImageType::TRUE_COLOR || get_image_type() == TGAImageType::TRUE_COLOR_RLE)
 		{
-			out_buffer[1] = 0x00; // Setting this to zero to ensure compatibility
-			out_buffer[3] = 0x00;
-			out_buffer[4] = 0x00;
-			out_buffer[5] = 0x00;
-			out_buffer[6] = 0x00;
-			out_buffer[7] = 0x00;
+			data[1] = 0x00; // Setting this to zero to ensure compatibility
+			data[3] = 0x00;
+			data[4] = 0x00;
+			data[5] = 0x00;
+			data[6] = 0x00;
+			data[7] = 0x00;
 		}
 		else
 		{
-			out_buffer[1] = header.color_map_type;
-			out_buffer[3] = static_cast<uint8_t>(header.first_entry_index & 0x00FF);
-			out_buffer[4] = static_cast<uint8_t>((header.first_entry_index >> 8) & 0x00FF);
-			out_buffer[5] = static_cast<uint8_t>(header.color_map_length & 0x00FF);
-			out_buffer[6] = static_cast<uint8_t>((header.color_map_length >> 8) & 0x00FF);
-			out_buffer[7] = header.color_map_entry_size;
+			data[1] = header.color_map_type;
+			data[3] = static_cast<uint8_t>(header.first_entry_index & 0x00FF);
+			data[4] = static_cast<uint8_t>((header.first_entry_index >> 8) & 0x00FF);
+			data[5] = static_cast<uint8_t>(header.color_map_length & 0x00FF);
+			data[6] = static_cast<uint8_t>((header.color_map_length >> 8) & 0x00FF);
+			data[7] = header.color_map_entry_size;
 		}
-		out_buffer[2]  = header.image_type;
-		out_buffer[8]  = static_cast<uint8_t>(header.x_origin & 0x00FF);
-		out_buffer[9]  = static_cast<uint8_t>((header.x_origin >> 8) & 0x00FF);
-		out_buffer[10] = static_cast<uint8_t>(header.y_origin & 0x00FF);
-		out_buffer[11] = static_cast<uint8_t>((header.y_origin >> 8) & 0x00FF);
-		out_buffer[12] = static_cast<uint8_t>(header.image_width & 0x00FF);
-		out_buffer[13] = static_cast<uint8_t>((header.image_width >> 8) & 0x00FF);
-		out_buffer[14] = static_cast<uint8_t>(header.image_height & 0x00FF);
-		out_buffer[15] = static_cast<uint8_t>((header.image_height >> 8) & 0x00FF);
-		out_buffer[16] = header.pixel_depth;
-		out_buffer[17] = header.image_descriptor;
+		data[2]  = header.image_type;
+		data[8]  = static_cast<uint8_t>(header.x_origin & 0x00FF);
+		data[9]  = static_cast<uint8_t>((header.x_origin >> 8) & 0x00FF);
+		data[10] = static_cast<uint8_t>(header.y_origin & 0x00FF);
+		data[11] = static_cast<uint8_t>((header.y_origin >> 8) & 0x00FF);
+		data[12] = static_cast<uint8_t>(header.image_width & 0x00FF);
+		data[13] = static_cast<uint8_t>((header.image_width >> 8) & 0x00FF);
+		data[14] = static_cast<uint8_t>(header.image_height & 0x00FF);
+		data[15] = static_cast<uint8_t>((header.image_height >> 8) & 0x00FF);
+		data[16] = header.pixel_depth;
+		data[17] = header.image_descriptor;
 	}
 }
 
-void TGA::write_data()
+void TGA::write_data(uint8_t* data) const
 {
-	// Computing the offset (from the start of the file) to the first byte of image data
-	int start_offset = 18; // Starting from the first byte after the header
-	start_offset += static_cast<int>(header.id_length); // Skipping image id field
-	if (header.color_map_type != 0) // Skipping color map data field
-	{
-		// When need to ceil to get the right amount of bytes because the number of bits may be 15
-		start_offset += static_cast<int>(header.color_map_length) * 
-						static_cast<int>(ceil(static_cast<int>(header.color_map_entry_size) / 8));
-	}
+	const int start_offset = get_data_offset();
 
-	if (get_image_type() == TGAImageType::TRUE_COLOR)
+	if (!is_rle() && data)
 	{
-		const int image_width = static_cast<int>(header.image_width);
-		const int image_height = static_cast<int>(header.image_height);
 		const int bytes_per_pixel = header.pixel_depth / 8;
-
-		if (out_buffer && pixels)
+		const size_t pixel_count = static_cast<size_t>(header.image_width) * header.image_height;
+		if (gray_pixels)
 		{
-			int i = (vert_orient == TGAVertOrientation::TOP_DOWN ? 0 : image_height - 1);
-			while (i != (vert_orient == TGAVertOrientation::TOP_DOWN ? image_height : -1))
-			{
-				int j = (horiz_orient == TGAHorizOrientation::LEFT_TO_RIGHT ? 0 : image_width - 1);
-				while (j != (horiz_orient == TGAHorizOrientation::LEFT_TO_RIGHT ? image_width : -1))
-				{
-					const int curr_pixel_offset = start_offset + (i * image_width + j) * bytes_per_pixel;
-					// The order in which the color bytes are displaced is BGRA
-					out_buffer[curr_pixel_offset] = static_cast<uint8_t>(std::min(1.f, pixels[i * image_width + j].blue) * 255.f);
-					out_buffer[curr_pixel_offset + 1] = static_cast<uint8_t>(std::min(1.f, pixels[i * image_width + j].green) * 255.f);
-					out_buffer[curr_pixel_offset + 2] = static_cast<uint8_t>(std::min(1.f, pixels[i * image_width + j].red) * 255.f);
-					if (bytes_per_pixel == 4)
-					{
-						out_buffer[curr_pixel_offset + 3] = static_cast<uint8_t>(std::min(1.f, pixels[i * image_width + j].alpha) * 255.f);
-					}
+			encode_pixels<1>(gray_pixels, data + start_offset, pixel_count);
+		}
+		else if (packed_pixels)
+		{
+			encode_pixels(packed_pixels, data + start_offset, pixel_count, bytes_per_pixel);
+		}
+		else if (planes)
+		{
+			encode_bgr_planes(planes, pixel_count, data + start_offset, pixel_count, bytes_per_pixel, threads);
+		}
+		else if (pixels)
+		{
+			encode_bgr_pixels(pixels, data + start_offset, pixel_count, bytes_per_pixel, threads);
+		}
+	}
+}
 
-					horiz_orient == TGAHorizOrientation::LEFT_TO_RIGHT ? j++ : j--;
-				}
+size_t TGA::write_rle_data(uint8_t* data, const size_t capacity) const
+{
+	const int image_width = static_cast<int>(header.image_width);
+	const int image_height = static_cast<int>(header.image_height);
+	const int bytes_per_pixel = header.pixel_depth / 8;
 
-				vert_orient == TGAVertOrientation::TOP_DOWN ? i++ : i--;
-			}
+	// Every row is encoded in the file pixel format first, then packed
+	std::vector<uint8_t> row(static_cast<size_t>(image_width) * bytes_per_pixel);
+	uint8_t* dst = data;
+	const uint8_t* const end = data + capacity;
+	for (int i = 0; i < image_height; i++)
+	{
+		if (gray_pixels)
+		{
+			encode_pixels<1>(gray_pixels + static_cast<ptrdiff_t>(i) * image_width, row.data(), image_width);
+		}
+		else if (packed_pixels)
+		{
+			encode_pixels(packed_pixels + static_cast<ptrdiff_t>(i) * image_width, row.data(), image_width, bytes_per_pixel);
+		}
+		else if (planes)
+		{
+			const Planes pixels = { planes, static_cast<size_t>(image_width) * image_height, get_plane_count() };
+			encode_pixels(pixels + static_cast<size_t>(i) * image_width, row.data(), image_width, bytes_per_pixel);
+		}
+		else if (pixels)
+		{
+			encode_pixels(pixels + static_cast<ptrdiff_t>(i) * image_width, row.data(), image_width, bytes_per_pixel);
 		}
+		dst = (bytes_per_pixel == 4 ? encode_rle_row<4>(row.data(), image_width, dst, end) :
+			   bytes_per_pixel == 3 ? encode_rle_row<3>(row.data(), image_width, dst, end) :
+									  encode_rle_row<1>(row.data(), image_width, dst, end));
 	}
+	return static_cast<size_t>(dst - data);
 }
 
-void TGA::write_footer()
+void TGA::write_footer(uint8_t* data, const size_t size) const
 {
-	if (format == TGAFormat::NEW)
+	if (format == TGAFormat::NEW && size >= 26)
 	{
-		if (out_buffer)
+		if (data)
 		{
-			out_buffer[buffer_size - 26] = static_cast<uint8_t>(footer.ext_area_offset & 0x000000FF);
-			out_buffer[buffer_size - 25] = static_cast<uint8_t>((footer.ext_area_offset >> 8) & 0x000000FF);
-			out_buffer[buffer_size - 24] = static_cast<uint8_t>((footer.ext_area_offset >> 16) & 0x000000FF);
-			out_buffer[buffer_size - 23] = static_cast<uint8_t>((footer.ext_area_offset >> 24) & 0x000000FF);
-			out_buffer[buffer_size - 22] = static_cast<uint8_t>(footer.dev_dir_offset & 0x000000FF);
-			out_buffer[buffer_size - 21] = static_cast<uint8_t>((footer.dev_dir_offset >> 8) & 0x000000FF);
-			out_buffer[buffer_size - 20] = static_cast<uint8_t>((footer.dev_dir_offset >> 16) & 0x000000FF);
-			out_buffer[buffer_size - 19] = static_cast<uint8_t>((footer.dev_dir_offset >> 24) & 0x000000FF);
-			for (int i = 0, j = buffer_size - 18; i < SIGNATURE_SIZE; i++, j++)
+			// The extension area and the developer directory aren't written again after compressed data, whose size
+			// changes, so their offsets are cleared
+			const bool keeps_layout = !is_rle();
+			const uint32_t ext_area_offset = (keeps_layout ? footer.ext_area_offset : 0);
+			const uint32_t dev_dir_offset = (keeps_layout ? footer.dev_dir_offset : 0);
+			data[size - 26] = static_cast<uint8_t>(ext_area_offset & 0x000000FF);
+			data[size - 25] = static_cast<uint8_t>((ext_area_offset >> 8) & 0x000000FF);
+			data[size - 24] = static_cast<uint8_t>((ext_area_offset >> 16) & 0x000000FF);
+			data[size - 23] = static_cast<uint8_t>((ext_area_offset >> 24) & 0x000000FF);
+			data[size - 22] = static_cast<uint8_t>(dev_dir_offset & 0x000000FF);
+			data[size - 21] = static_cast<uint8_t>((dev_dir_offset >> 8) & 0x000000FF);
+			data[size - 20] = static_cast<uint8_t>((dev_dir_offset >> 16) & 0x000000FF);
+			data[size - 19] = static_cast<uint8_t>((dev_dir_offset >> 24) & 0x000000FF);
+			for (int i = 0; i < SIGNATURE_SIZE; i++)
 			{
-				out_buffer[j] = static_cast<uint8_t>(footer.signature[i]);
+				data[size - 18 + i] = static_cast<uint8_t>(footer.signature[i]);
 			}
-			out_buffer[buffer_size - 2] = '.';
-			out_buffer[buffer_size - 1] = 0x00;
+			data[size - 2] = '.';
+			data[size - 1] = 0x00;
 		}
 	}
 }
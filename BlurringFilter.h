@@ -1,30 +1,17 @@
 #pragma once
 
+#include "ImageBlur.h"
 #include <stdint.h>
+#include <iosfwd>
 #include <string>
+#include <vector>
 
 
-struct RGBA
+enum class BlurEngine : uint8_t
 {
-	RGBA();
-	RGBA(float c, float a);
-	RGBA(float r, float g, float b, float a);
-
-	friend bool operator == (const RGBA& lhs, const RGBA& rhs);
-	friend bool operator != (const RGBA& lhs, const RGBA& rhs);
-	RGBA& operator += (const RGBA& rhs);
-	friend RGBA operator + (RGBA lhs, const RGBA& rhs);
-	RGBA& operator -= (const RGBA& rhs);
-	friend RGBA operator - (RGBA lhs, const RGBA& rhs);
-	RGBA& operator *= (const RGBA& rhs);
-	friend RGBA operator * (RGBA lhs, const RGBA& rhs);
-	RGBA& operator /= (const RGBA& rhs);
-	friend RGBA operator / (RGBA lhs, const RGBA& rhs);
-
-	float red;
-	float green;
-	float blue;
-	float alpha;
+	FLOAT,   // Pixels widened to float RGBA, float running sums
+	INTEGER, // Pixels kept as packed 8-bit BGRA, exact integer running sums
+	PLANAR   // Same float sums of FLOAT on a plane per channel (no alpha plane for 24 bit images)
 };
 
 enum class TGAFormat : uint8_t
@@ -90,18 +77,61 @@ class TGA
 {
 public:
 
-	TGA(const std::string& path);
+	TGA(const std::string& path, BlurEngine engine = BlurEngine::FLOAT);
+	// Empty image, parse() loads one. The same object can parse, blur and write any number of images in a row,
+	// reusing the pixel buffer as long as it's big enough
+	explicit TGA(BlurEngine engine = BlurEngine::FLOAT);
 	~TGA();
 
+	TGA(const TGA&) = delete;
+	TGA& operator = (const TGA&) = delete;
+
+	// Stages of the following parse/blur/write calls are timed into stats, nullptr (the default) turns it off
+	void set_stats(BlurStats* stats);
+	// Scratch memory of the following blur calls, nullptr (the default) uses the one of the calling thread
+	void set_workspace(BlurWorkspace* workspace);
+	// Threads converting the pixels of the following parse/write calls (the blur takes its own count), 1 by default
+	void set_threads(int threads);
+	// Tolerance of the following BlurMode::APPROXIMATE blurs (see blur_image_approximate())
+	void set_tolerance(float tolerance);
+
+	int get_width() const;
+	int get_height() const;
 	TGAImageType get_image_type() const;
 	std::string get_image_type_name() const;
 	RGBA* get_mirror_padded_image(const int pad) const;
-
+	// Memory taken by the pixels of the image
+	size_t get_pixel_bytes() const;
+	// The pixels in memory, RGBA_F32 for the float engine, BGRA8 for the integer one and PLANAR_RGB(A)_F32 for the
+	// planar one, GRAY8 for mono images whatever the engine. It stays valid until the next parse of a bigger image.
+	ImageView get_view() const;
+
+	// Both map the file in memory when the OS allows it, falling back to file streams otherwise. STANDARD_STREAM
+	// ("-") as path reads the whole standard input, or writes to the standard output.
 	void parse(const std::string& path);
 	void write(const std::string& path);
-
-	void blur(float factor);
-
+	// Same as parsing again the file other was parsed from (other needs the same engine), without the file
+	void copy_from(const TGA& other);
+
+	// Same as blur_image() on get_view(), or blur_image_approximate() with the tolerance set for the approximate mode
+	void blur(float factor, int threads = 1, BlurMode mode = BlurMode::BOX);
+	// Blurs only roi, given as seen on screen (x from the left, y from the top) whatever the orientation of the file
+	void blur(const BlurRect& roi, float factor, int threads = 1, BlurMode mode = BlurMode::BOX);
+
+	// Blurs the image once for every factor and writes each result to the path of the same index, leaving the image
+	// as it is: it's decoded once, the SAT mode builds a single table for all the factors (see blur_image_multi()),
+	// and the outputs are encoded and written concurrently by the threads
+	void blur_multi(const std::vector<float>& factors, const std::vector<std::string>& out_paths, int threads = 1,
+					BlurMode mode = BlurMode::BOX);
+
+	// Same blur as the float engine, but reading, filtering and writing the image a few rows at a time: it
+	// never holds the whole image, only about kernel_size rows of it (see StreamBlur). The input is read once from
+	// start to end, so either path can be STANDARD_STREAM (pipes included).
+	static void blur_stream(const std::string& in_path, const std::string& out_path, float factor,
+							BlurStats* stats = nullptr);
+	static void blur_stream(std::istream& is, std::ostream& os, float factor, BlurStats* stats = nullptr);
+
+	static const std::string STANDARD_STREAM;
 	static const std::string SIGNATURE;
 	static const int SIGNATURE_SIZE;
 	static const std::string TYPE_COLOR_MAPPED_NAME;
@@ -113,16 +143,40 @@ public:
 
 private:
 
-	void parse_header();
-	void parse_data();
-	void parse_footer();
-	void write_header();
-	void write_data();
-	void write_footer();
-
-	uint8_t* in_buffer = nullptr;
-	uint8_t* out_buffer = nullptr;
-	int buffer_size = 0;
+	// Offset (from the start of the file) to the first byte of image data
+	int get_data_offset() const;
+	// Maps the 0 < f < 1 blur factor to an odd kernel size, 0 or less means no blur at all
+	int get_kernel_size(float factor) const;
+
+	// Whole file in memory (buffer_size bytes), mapped or read in a buffer. The output needs get_max_output_size()
+	// bytes, write returns how many it actually used (less for run-length encoded images).
+	void parse(const uint8_t* data);
+	size_t write(uint8_t* data) const;
+	size_t get_max_output_size() const;
+
+	// Header of other and room for its pixels, which are left as they were
+	void copy_header_from(const TGA& other);
+	// Makes room for pixel_count pixels, keeping the buffer when it's big enough already
+	void reserve_pixels(const size_t pixel_count);
+	// Planes of the planar engine, 4 for 32 bit images and 3 for the others
+	int get_plane_count() const;
+	PixelLayout get_layout() const;
+	// Mono (8 bit gray) images, plain or run-length encoded
+	bool is_mono() const;
+	// Run-length encoded images, true color or mono
+	bool is_rle() const;
+	void parse_header(const uint8_t* data);
+	void parse_data(const uint8_t* data, const size_t size);
+	void parse_rle_data(const uint8_t* data, const size_t size);
+	void parse_footer(const uint8_t* data, const size_t size);
+	void write_header(uint8_t* data) const;
+	void write_data(uint8_t* data) const;
+	size_t write_rle_data(uint8_t* data, const size_t capacity) const;
+	void write_footer(uint8_t* data, const size_t size) const;
+
+
+	// Size of the file, the output one is the same size of the input one (unless it's run-length encoded)
+	size_t buffer_size = 0;
 
 	TGAFormat format = TGAFormat::NONE;
 	TGAImageType image_type = TGAImageType::EMPTY;
@@ -132,5 +186,33 @@ private:
 	TGAHeader header;
 	TGAFooter footer;
 	
+	BlurEngine engine = BlurEngine::FLOAT;
 	RGBA* pixels = nullptr;
+	// Used instead of pixels by the integer engine, one BGRA pixel per word (same byte order of the file)
+	uint32_t* packed_pixels = nullptr;
+	// Used by the planar engine, get_plane_count() planes of width * height floats one after the other
+	float* planes = nullptr;
+	// Used by mono images whatever the engine, a gray byte per pixel (never widened)
+	uint8_t* gray_pixels = nullptr;
+	// Bytes the buffer above in use can hold, it only grows
+	size_t pixels_capacity = 0;
+
+	BlurStats* stats = nullptr;
+	BlurWorkspace* workspace = nullptr;
+	int threads = 1;
+	float tolerance = DEFAULT_BLUR_TOLERANCE;
 };
+
+// Headerless images for pipelines: width x height pixels of channels (3 or 4) interleaved bytes, rows from the top,
+// any order of the color channels and alpha last. Alpha comes out opaque like with the other engines.
+struct RawFormat
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+};
+
+// Same blur as TGA::blur_stream() on raw frames, one after the other until the input ends (a video piped frame by
+// frame keeps going through the same process). Either path can be TGA::STANDARD_STREAM.
+void blur_raw_stream(const std::string& in_path, const std::string& out_path, const RawFormat& format, float factor,
+					 BlurStats* stats = nullptr);
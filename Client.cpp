@@ -0,0 +1,108 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+// Small client of the blur server (see Server.h), mostly for testing it:
+//
+// BlurringClient <socket> <input> <output> <factor>
+// BlurringClient <socket> stats|shutdown
+// BlurringClient <socket>                            requests read from stdin, one per line
+//
+// Every answer is printed on stdout, the exit code is 1 when any of them is an error.
+
+#ifdef _WIN32
+
+int main()
+{
+	std::cerr << "Caught: The blur server needs Unix domain sockets, it's not available on Windows" << std::endl;
+	return 1;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")
+	{
+		std::cout << "Syntax: BlurringClient <socket> [<input> <output> <factor> | stats | shutdown]" << std::endl;
+		std::cout << "        without a request, one request per line is read from stdin" << std::endl;
+		return argc < 2 ? 1 : 0;
+	}
+
+	std::vector<std::string> requests;
+	if (argc > 2)
+	{
+		std::string request = argv[2];
+		for (int i = 3; i < argc; i++)
+		{
+			request += " ";
+			request += argv[i];
+		}
+		requests.push_back(request);
+	}
+	else
+	{
+		std::string line;
+		while (std::getline(std::cin, line))
+		{
+			if (!line.empty())
+			{
+				requests.push_back(line);
+			}
+		}
+	}
+
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, argv[1], sizeof(address.sun_path) - 1);
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0)
+	{
+		std::cerr << "Caught: Unable to connect to " << argv[1] << " (" << strerror(errno) << ")" << std::endl;
+		return 1;
+	}
+
+	// One request at a time, each one waits for its answer
+	bool failed = false;
+	std::string pending;
+	for (const std::string& request : requests)
+	{
+		const std::string data = request + "\n";
+		if (::send(fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size()))
+		{
+			std::cerr << "Caught: Connection lost" << std::endl;
+			return 1;
+		}
+		size_t end = pending.find('\n');
+		while (end == std::string::npos)
+		{
+			char chunk[4096];
+			const ssize_t count = ::recv(fd, chunk, sizeof(chunk), 0);
+			if (count <= 0)
+			{
+				std::cerr << "Caught: Connection lost" << std::endl;
+				return 1;
+			}
+			pending.append(chunk, static_cast<size_t>(count));
+			end = pending.find('\n');
+		}
+		const std::string answer = pending.substr(0, end);
+		pending.erase(0, end + 1);
+		std::cout << answer << std::endl;
+		failed = failed || answer.compare(0, 5, "error") == 0;
+	}
+	::close(fd);
+	return failed ? 1 : 0;
+}
+
+#endif
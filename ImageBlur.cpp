@@ -0,0 +1,1864 @@
+#include "ImageBlur.h"
+#include "BlurKernels.h"
+#include "BlurStats.h"
+#include "BlurWorkspace.h"
+#include <stdexcept>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+
+RGBA::RGBA() : red(0.f), green(0.f), blue(0.f), alpha(1.f) {}
+RGBA::RGBA(float c, float a) : red(c), green(c), blue(c), alpha(a) {}
+RGBA::RGBA(float r, float g, float b, float a) : red(r), green(g), blue(b), alpha(a) {}
+
+bool operator == (const RGBA& lhs, const RGBA& rhs)
+{
+	return lhs.red == rhs.red && lhs.green == rhs.green &&
+		   lhs.blue == rhs.blue && lhs.alpha == rhs.alpha;
+}
+
+bool operator != (const RGBA& lhs, const RGBA& rhs)
+{
+	return !(lhs == rhs);
+}
+
+RGBA& RGBA::operator += (const RGBA& rhs)
+{
+	red += rhs.red;
+	green += rhs.green;
+	blue += rhs.blue;
+	return *this;
+}
+
+RGBA operator + (RGBA lhs, const RGBA& rhs)
+{
+	return lhs += rhs;
+}
+
+RGBA& RGBA::operator -= (const RGBA& rhs)
+{
+	red -= rhs.red;
+	green -= rhs.green;
+	blue -= rhs.blue;
+	return *this;
+}
+
+RGBA operator - (RGBA lhs, const RGBA& rhs)
+{
+	return lhs -= rhs;
+}
+
+RGBA& RGBA::operator *= (const RGBA& rhs)
+{
+	red *= rhs.red;
+	green *= rhs.green;
+	blue *= rhs.blue;
+	return *this;
+}
+
+RGBA operator * (RGBA lhs, const RGBA& rhs)
+{
+	return lhs *= rhs;
+}
+
+RGBA& RGBA::operator /= (const RGBA& rhs)
+{
+	red /= rhs.red;
+	green /= rhs.green;
+	blue /= rhs.blue;
+	return *this;
+}
+
+RGBA operator / (RGBA lhs, const RGBA & rhs)
+{
+	return lhs /= rhs;
+}
+
+size_t get_pixel_size(PixelLayout layout)
+{
+	switch (layout)
+	{
+	case PixelLayout::RGBA_F32:
+		return sizeof(RGBA);
+	case PixelLayout::PLANAR_RGB_F32:
+	case PixelLayout::PLANAR_RGBA_F32:
+		return sizeof(float);
+	case PixelLayout::GRAY8:
+		return sizeof(uint8_t);
+	default:
+		return sizeof(uint32_t);
+	}
+}
+
+int get_plane_count(PixelLayout layout)
+{
+	return layout == PixelLayout::PLANAR_RGBA_F32 ? 4 : layout == PixelLayout::PLANAR_RGB_F32 ? 3 : 1;
+}
+
+ImageView::ImageView(void* data, int width, int height, PixelLayout layout, ptrdiff_t stride) :
+	data(static_cast<uint8_t*>(data)), width(width), height(height),
+	stride(stride != 0 ? stride : static_cast<ptrdiff_t>(width) * get_pixel_size(layout)), layout(layout)
+{
+}
+
+int get_blur_kernel_size(int width, int height, float factor)
+{
+	if (factor < 0.f || factor > 1.f)
+	{
+		throw std::invalid_argument("Invalid blur factor (it needs to be in the 0 < f < 1 range)");
+	}
+
+	// Linear interpolation between 0 < x < 1 and 0 < y < min(image_height, image_width) / 2
+	const int max_kernel_size = std::min(height, width) / 2;
+	int kernel_size = static_cast<int>(round(max_kernel_size * factor));
+
+	if (kernel_size % 2 == 0)
+	{
+		// Having only odd values is required
+		kernel_size--;
+	}
+	return kernel_size;
+}
+
+// Shared by both engines, Pixel is either RGBA or a packed 8-bit BGRA word. padded_img has room for
+// (image_width + 2 * pad) x (image_height + 2 * pad) pixels.
+template <typename Pixel>
+static void mirror_pad(const Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+					   const int pad, Pixel* padded_img)
+{
+	if (pad > image_height || pad > image_width)
+	{
+		throw std::invalid_argument("Pad size cannot exceed the dimensions of the image");
+	}
+
+	const int padded_img_height = image_height + 2 * pad;
+	const int padded_img_width = image_width + 2 * pad;
+	if (padded_img && pixels)
+	{
+		for (int i = 0; i < padded_img_height; i++)
+		{
+			int mirr_i = 0;
+			if (i < pad)
+			{
+				// Top pad
+				mirr_i = pad - i;
+			}
+			else if (i < pad + image_height)
+			{
+				// Middle
+				mirr_i = i - pad;
+			}
+			else
+			{
+				// Bottom pad
+				mirr_i = image_height - 1 - (i - (pad + image_height) + 1);
+			}
+			for (int j = 0; j < padded_img_width; j++)
+			{
+				int mirr_j = 0;
+				if (j < pad)
+				{
+					// Left pad
+					mirr_j = pad - j;
+				}
+				else if (j < pad + image_width)
+				{
+					// Middle
+					mirr_j = j - pad;
+				}
+				else
+				{
+					// Right pad
+					mirr_j = image_width - 1 - (j - (pad + image_width) + 1);
+				}
+
+				padded_img[i * padded_img_width + j] = pixels[mirr_i * stride + mirr_j];
+			}
+		}
+	}
+}
+
+RGBA* get_mirror_padded_image(const ImageView& image, int pad)
+{
+	if (image.layout != PixelLayout::RGBA_F32)
+	{
+		throw std::invalid_argument("Only float images can be mirror padded");
+	}
+	if (pad > image.height || pad > image.width)
+	{
+		throw std::invalid_argument("Pad size cannot exceed the dimensions of the image");
+	}
+	RGBA* padded_img = new RGBA[static_cast<size_t>(image.width + 2 * pad) * (image.height + 2 * pad)];
+	mirror_pad(reinterpret_cast<const RGBA*>(image.data), image.width, image.height,
+			   image.stride / static_cast<ptrdiff_t>(sizeof(RGBA)), pad, padded_img);
+	return padded_img;
+}
+
+// Never more workers than there are rows/columns to hand out
+static int get_band_count(const int count, const int threads)
+{
+	return std::max(1, std::min(threads, count));
+}
+
+// Calls band(index, first, last) for get_band_count() contiguous ranges of [0, count), one per thread. With a
+// single band nothing is spawned (nor allocated).
+template <typename Band>
+static void run_in_bands(const int count, const int threads, const Band& band)
+{
+	const int workers = get_band_count(count, threads);
+	if (workers == 1)
+	{
+		band(0, 0, count);
+		return;
+	}
+
+	std::vector<std::thread> pool;
+	pool.reserve(workers - 1);
+	for (int w = 1; w < workers; w++)
+	{
+		// Contiguous bands, with the remainder spread over the first ones
+		const int first = static_cast<int>(static_cast<long long>(count) * w / workers);
+		const int last = static_cast<int>(static_cast<long long>(count) * (w + 1) / workers);
+		pool.emplace_back(band, w, first, last);
+	}
+	// The calling thread takes care of the first band instead of idling on the join
+	band(0, 0, static_cast<int>(static_cast<long long>(count) / workers));
+
+	for (std::thread& t : pool)
+	{
+		t.join();
+	}
+}
+
+// The conversions go in bands of whole blocks of pixels, images smaller than a block never spawn a thread
+static const size_t CONVERSION_BLOCK = 16384;
+
+template <typename Convert>
+static void convert_in_bands(const size_t count, const int threads, const Convert& convert)
+{
+	const int blocks = static_cast<int>((count + CONVERSION_BLOCK - 1) / CONVERSION_BLOCK);
+	run_in_bands(blocks, threads, [&](int, int first_block, int last_block)
+	{
+		const size_t first = first_block * CONVERSION_BLOCK;
+		convert(first, std::min(count, last_block * CONVERSION_BLOCK) - first);
+	});
+}
+
+void decode_bgr_pixels(const uint8_t* src, RGBA* dst, size_t count, int bytes_per_pixel, int threads)
+{
+	const BlurKernels& kernels = get_blur_kernels();
+	convert_in_bands(count, threads, [&](const size_t first, const size_t size)
+	{
+		kernels.decode_bgr(src + first * bytes_per_pixel, dst + first, size, bytes_per_pixel);
+	});
+}
+
+void encode_bgr_pixels(const RGBA* src, uint8_t* dst, size_t count, int bytes_per_pixel, int threads)
+{
+	const BlurKernels& kernels = get_blur_kernels();
+	convert_in_bands(count, threads, [&](const size_t first, const size_t size)
+	{
+		kernels.encode_bgr(src + first, dst + first * bytes_per_pixel, size, bytes_per_pixel);
+	});
+}
+
+// The planar conversions take the planes at the first pixel of their block
+void decode_bgr_planes(const uint8_t* src, float* planes, size_t plane_size, size_t count, int bytes_per_pixel, int threads)
+{
+	const BlurKernels& kernels = get_blur_kernels();
+	convert_in_bands(count, threads, [&](const size_t first, const size_t size)
+	{
+		float* const block[4] = { planes + first, planes + plane_size + first, planes + 2 * plane_size + first,
+								  planes + 3 * plane_size + first };
+		kernels.decode_bgr_planes(src + first * bytes_per_pixel, block, size, bytes_per_pixel);
+	});
+}
+
+void encode_bgr_planes(const float* planes, size_t plane_size, uint8_t* dst, size_t count, int bytes_per_pixel, int threads)
+{
+	const BlurKernels& kernels = get_blur_kernels();
+	convert_in_bands(count, threads, [&](const size_t first, const size_t size)
+	{
+		const float* const block[4] = { planes + first, planes + plane_size + first, planes + 2 * plane_size + first,
+										planes + 3 * plane_size + first };
+		kernels.encode_bgr_planes(block, dst + first * bytes_per_pixel, size, bytes_per_pixel);
+	});
+}
+
+// Scratch of every band of a run_in_bands() call, band_size elements each (rounded to whole cache lines so bands
+// don't share any) in buffer index of the workspace. Band b starts at b * band_size.
+template <typename T>
+static T* get_band_buffers(BlurWorkspace& workspace, const int index, const int count, const int threads, size_t& band_size,
+						   BlurStats* stats)
+{
+	const size_t line_elements = BlurWorkspace::ALIGNMENT / sizeof(T);
+	band_size = (band_size + line_elements - 1) / line_elements * line_elements;
+	const size_t size = get_band_count(count, threads) * band_size;
+	if (stats)
+	{
+		stats->scratch_bytes += size * sizeof(T);
+	}
+	return workspace.get_buffer<T>(index, size);
+}
+
+// Rows are filtered ROW_CHUNK at a time (enough for the widest vector row kernel) and columns in strips of
+// STRIP_WIDTH. Both are copied in a scratch buffer along with their mirrored borders first, which is all the
+// extra memory the blur needs: the image itself is filtered in place, with no padded copy of it.
+static const int ROW_CHUNK = 8;
+static const int STRIP_WIDTH = 64;
+
+// Reflect pads a line of width pixels starting at line + pad
+template <typename Pixel>
+static void mirror_line(Pixel* line, const int width, const int pad)
+{
+	for (int j = 0; j < pad; j++)
+	{
+		line[j] = line[2 * pad - j];
+		line[pad + width + j] = line[pad + width - 2 - j];
+	}
+}
+
+// Same for the rows of a strip, height rows of cols pixels starting at strip + pad * STRIP_WIDTH
+template <typename Pixel>
+static void mirror_strip(Pixel* strip, const int cols, const int height, const int pad)
+{
+	for (int i = 0; i < pad; i++)
+	{
+		const Pixel* top = strip + static_cast<ptrdiff_t>(2 * pad - i) * STRIP_WIDTH;
+		const Pixel* bottom = strip + static_cast<ptrdiff_t>(pad + height - 2 - i) * STRIP_WIDTH;
+		std::copy(top, top + cols, strip + static_cast<ptrdiff_t>(i) * STRIP_WIDTH);
+		std::copy(bottom, bottom + cols, strip + static_cast<ptrdiff_t>(pad + height + i) * STRIP_WIDTH);
+	}
+}
+
+// Runs passes box filters in a row (one kernel size each). Every chunk of rows and every strip of columns goes
+// through all of them in the scratch buffers, ping-ponging between two of them, and only the last one writes
+// back to the image: more passes don't mean more round trips through the whole image.
+template <typename Pixel, typename RowsKernel>
+static void blur_rows_in_place(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+							   const int* kernel_sizes, const int passes, const int threads, RowsKernel blur_rows,
+							   BlurWorkspace& workspace, BlurStats* stats)
+{
+	const int max_pad = *std::max_element(kernel_sizes, kernel_sizes + passes) / 2;
+	const int buffers = (passes > 1 ? 2 : 1);
+
+	const int line_width = image_width + 2 * max_pad;
+	const size_t chunk_size = static_cast<size_t>(ROW_CHUNK) * line_width;
+	size_t band_size = buffers * chunk_size;
+	Pixel* scratch = get_band_buffers<Pixel>(workspace, 0, image_height, threads, band_size, stats);
+	run_in_bands(image_height, threads, [&](int band, int first_row, int last_row)
+	{
+		Pixel* lines = scratch + band * band_size;
+		for (int i = first_row; i < last_row; i += ROW_CHUNK)
+		{
+			const int rows = std::min(ROW_CHUNK, last_row - i);
+			Pixel* src = lines;
+			for (int r = 0; r < rows; r++)
+			{
+				const Pixel* row = pixels + (i + r) * stride;
+				Pixel* line = src + static_cast<ptrdiff_t>(r) * line_width;
+				std::copy(row, row + image_width, line + kernel_sizes[0] / 2);
+				mirror_line(line, image_width, kernel_sizes[0] / 2);
+			}
+			for (int p = 0; p < passes - 1; p++)
+			{
+				Pixel* dst = (src == lines ? lines + chunk_size : lines);
+				const int next_pad = kernel_sizes[p + 1] / 2;
+				blur_rows(src, line_width, dst + next_pad, line_width, rows, image_width, kernel_sizes[p]);
+				for (int r = 0; r < rows; r++)
+				{
+					mirror_line(dst + static_cast<ptrdiff_t>(r) * line_width, image_width, next_pad);
+				}
+				src = dst;
+			}
+			blur_rows(src, line_width, pixels + i * stride, stride, rows, image_width, kernel_sizes[passes - 1]);
+		}
+	});
+}
+
+// Column passes of the cols columns from j, through the strips buffers (strip_size pixels apart)
+template <typename Pixel, typename ColsKernel>
+static void blur_strip(Pixel* pixels, const int image_height, const ptrdiff_t stride, const int j, const int cols,
+					   const int* kernel_sizes, const int passes, ColsKernel blur_cols, Pixel* strips, const size_t strip_size)
+{
+	Pixel* src = strips;
+	const int pad = kernel_sizes[0] / 2;
+	for (int i = 0; i < image_height; i++)
+	{
+		const Pixel* row = pixels + i * stride + j;
+		std::copy(row, row + cols, src + static_cast<ptrdiff_t>(pad + i) * STRIP_WIDTH);
+	}
+	mirror_strip(src, cols, image_height, pad);
+	for (int p = 0; p < passes - 1; p++)
+	{
+		Pixel* dst = (src == strips ? strips + strip_size : strips);
+		const int next_pad = kernel_sizes[p + 1] / 2;
+		blur_cols(src, STRIP_WIDTH, dst + static_cast<ptrdiff_t>(next_pad) * STRIP_WIDTH, STRIP_WIDTH,
+				  cols, image_height, kernel_sizes[p]);
+		mirror_strip(dst, cols, image_height, next_pad);
+		src = dst;
+	}
+	blur_cols(src, STRIP_WIDTH, pixels + j, stride, cols, image_height, kernel_sizes[passes - 1]);
+}
+
+template <typename Pixel, typename ColsKernel>
+static void blur_cols_in_place(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+							   const int* kernel_sizes, const int passes, const int threads, ColsKernel blur_cols,
+							   BlurWorkspace& workspace, BlurStats* stats)
+{
+	const int max_pad = *std::max_element(kernel_sizes, kernel_sizes + passes) / 2;
+	const int buffers = (passes > 1 ? 2 : 1);
+
+	const int strip_height = image_height + 2 * max_pad;
+	const size_t strip_size = static_cast<size_t>(STRIP_WIDTH) * strip_height;
+	size_t band_size = buffers * strip_size;
+	Pixel* scratch = get_band_buffers<Pixel>(workspace, 0, image_width, threads, band_size, stats);
+	run_in_bands(image_width, threads, [&](int band, int first_col, int last_col)
+	{
+		for (int j = first_col; j < last_col; j += STRIP_WIDTH)
+		{
+			blur_strip(pixels, image_height, stride, j, std::min(STRIP_WIDTH, last_col - j), kernel_sizes, passes, blur_cols,
+					   scratch + band * band_size, strip_size);
+		}
+	});
+}
+
+template <typename Pixel, typename RowsKernel, typename ColsKernel>
+static void blur_in_place(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+						  const int* kernel_sizes, const int passes, const int threads, RowsKernel blur_rows, ColsKernel blur_cols,
+						  BlurWorkspace& workspace, BlurStats* stats)
+{
+	{
+		ScopedTimer timer(stats ? &stats->blur_rows : nullptr);
+		blur_rows_in_place(pixels, image_width, image_height, stride, kernel_sizes, passes, threads, blur_rows, workspace, stats);
+	}
+	{
+		ScopedTimer timer(stats ? &stats->blur_cols : nullptr);
+		blur_cols_in_place(pixels, image_width, image_height, stride, kernel_sizes, passes, threads, blur_cols, workspace, stats);
+	}
+}
+
+// The SAT and the reference sum every color channel in a wider type than the pixel one, alpha is left out
+// since all the modes make the result opaque: doubles for the float engine, exact 64 bit integers for the
+// integer one (large enough for 65535 x 65535 pixels of 255). The planes of planar images have a single one.
+template <typename Pixel>
+struct PixelSum;
+
+template <>
+struct PixelSum<RGBA>
+{
+	using type = double;
+	static const int channels = 3;
+};
+
+template <>
+struct PixelSum<uint32_t>
+{
+	using type = int64_t;
+	static const int channels = 3;
+};
+
+template <>
+struct PixelSum<float>
+{
+	using type = double;
+	static const int channels = 1;
+};
+
+template <>
+struct PixelSum<uint8_t>
+{
+	using type = int64_t;
+	static const int channels = 1;
+};
+
+static void add_channels(const RGBA& pixel, double* sums)
+{
+	sums[0] += pixel.red;
+	sums[1] += pixel.green;
+	sums[2] += pixel.blue;
+}
+
+static void add_channels(const uint32_t& pixel, int64_t* sums)
+{
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&pixel);
+	sums[0] += bytes[0];
+	sums[1] += bytes[1];
+	sums[2] += bytes[2];
+}
+
+static void add_channels(const float& value, double* sums)
+{
+	sums[0] += value;
+}
+
+static void add_channels(const uint8_t& value, int64_t* sums)
+{
+	sums[0] += value;
+}
+
+static void set_average(RGBA& pixel, const double* sums, const int64_t area)
+{
+	pixel = RGBA(static_cast<float>(sums[0] / area), static_cast<float>(sums[1] / area), static_cast<float>(sums[2] / area), 1.f);
+}
+
+static void set_average(float& value, const double* sums, const int64_t area)
+{
+	value = static_cast<float>(sums[0] / area);
+}
+
+static void set_average(uint8_t& value, const int64_t* sums, const int64_t area)
+{
+	value = static_cast<uint8_t>((sums[0] + area / 2) / area);
+}
+
+static void set_average(uint32_t& pixel, const int64_t* sums, const int64_t area)
+{
+	// Rounded to the nearest value
+	uint8_t* bytes = reinterpret_cast<uint8_t*>(&pixel);
+	bytes[0] = static_cast<uint8_t>((sums[0] + area / 2) / area);
+	bytes[1] = static_cast<uint8_t>((sums[1] + area / 2) / area);
+	bytes[2] = static_cast<uint8_t>((sums[2] + area / 2) / area);
+	bytes[3] = 0xFF;
+}
+
+// Inclusive range of rows (or columns) of the image
+struct Span
+{
+	int first;
+	int last;
+};
+
+// The kernel_size rows around center in the reflect padded image, as (at most 3) ranges of real rows: the ones
+// inside the image, plus the mirrored ones past the top and the bottom edges
+static int get_mirrored_spans(const int center, const int pad, const int size, Span* spans)
+{
+	int count = 0;
+	spans[count++] = { std::max(0, center - pad), std::min(size - 1, center + pad) };
+	if (center - pad < 0)
+	{
+		// Rows -1 ... center - pad mirror rows 1 ... pad - center
+		spans[count++] = { 1, pad - center };
+	}
+	if (center + pad > size - 1)
+	{
+		// Rows size ... center + pad mirror rows size - 2 ... 2 * size - 2 - (center + pad)
+		spans[count++] = { 2 * size - 2 - (center + pad), size - 2 };
+	}
+	return count;
+}
+
+// The table has a leading row and column of zeros, entry (i, j) sums the pixels above and left of it, channels
+// sums per entry. It goes in the first buffer of the workspace.
+template <typename Pixel>
+static typename PixelSum<Pixel>::type* build_sat(const Pixel* pixels, const int image_width, const int image_height,
+												 const ptrdiff_t stride, const int threads, BlurWorkspace& workspace,
+												 BlurStats* stats)
+{
+	using Sum = typename PixelSum<Pixel>::type;
+	const int channels = PixelSum<Pixel>::channels;
+
+	const ptrdiff_t table_stride = channels * static_cast<ptrdiff_t>(image_width + 1);
+	const size_t table_size = table_stride * (image_height + 1);
+	Sum* table = workspace.get_buffer<Sum>(0, table_size);
+	auto get_entry = [&](const int i, const int j) { return table + i * table_stride + channels * j; };
+	std::fill(table, table + table_stride, Sum(0));
+	if (stats)
+	{
+		stats->scratch_bytes += table_size * sizeof(Sum);
+	}
+
+	// Prefix sums along the rows...
+	run_in_bands(image_height, threads, [&](int, int first_row, int last_row)
+	{
+		for (int i = first_row; i < last_row; i++)
+		{
+			const Pixel* row = pixels + i * stride;
+			Sum* entry = get_entry(i + 1, 0);
+			std::fill(entry, entry + channels, Sum(0));
+			entry += channels;
+			Sum sums[3] = {};
+			for (int j = 0; j < image_width; j++, entry += channels)
+			{
+				add_channels(row[j], sums);
+				std::copy(sums, sums + channels, entry);
+			}
+		}
+	});
+	// ...then down the columns, a band of contiguous columns per thread
+	run_in_bands(image_width, threads, [&](int, int first_col, int last_col)
+	{
+		for (int i = 2; i <= image_height; i++)
+		{
+			const Sum* above = get_entry(i - 1, first_col + 1);
+			Sum* entry = get_entry(i, first_col + 1);
+			for (int c = 0; c < channels * (last_col - first_col); c++)
+			{
+				entry[c] += above[c];
+			}
+		}
+	});
+	return table;
+}
+
+// Box blur of the image the table was built from, written to pixels (which can be that same image). There's no
+// padded copy of the image: windows crossing the edges are summed as their mirrored pieces instead.
+template <typename Pixel>
+static void blur_from_sat(const typename PixelSum<Pixel>::type* table, Pixel* pixels, const int image_width,
+						  const int image_height, const ptrdiff_t stride, const int kernel_size, const int threads,
+						  BlurWorkspace& workspace, BlurStats* stats)
+{
+	using Sum = typename PixelSum<Pixel>::type;
+	const int channels = PixelSum<Pixel>::channels;
+	const int pad = kernel_size / 2;
+
+	const ptrdiff_t table_stride = channels * static_cast<ptrdiff_t>(image_width + 1);
+	auto get_entry = [&](const int i, const int j) { return table + i * table_stride + channels * j; };
+
+	Span* col_spans = workspace.get_buffer<Span>(1, 3 * static_cast<size_t>(image_width));
+	int* col_span_counts = workspace.get_buffer<int>(2, image_width);
+	if (stats)
+	{
+		stats->scratch_bytes += 3 * image_width * sizeof(Span) + image_width * sizeof(int);
+	}
+	for (int j = 0; j < image_width; j++)
+	{
+		col_span_counts[j] = get_mirrored_spans(j, pad, image_width, &col_spans[3 * j]);
+	}
+
+	const int64_t area = static_cast<int64_t>(kernel_size) * kernel_size;
+	run_in_bands(image_height, threads, [&](int, int first_row, int last_row)
+	{
+		for (int i = first_row; i < last_row; i++)
+		{
+			Span row_spans[3];
+			const int row_span_count = get_mirrored_spans(i, pad, image_height, row_spans);
+			for (int j = 0; j < image_width; j++)
+			{
+				// Away from the edges that's a single rectangle, 4 lookups
+				Sum sums[3] = {};
+				for (int r = 0; r < row_span_count; r++)
+				{
+					for (int c = 0; c < col_span_counts[j]; c++)
+					{
+						const Span& rows = row_spans[r];
+						const Span& cols = col_spans[3 * j + c];
+						const Sum* bottom_right = get_entry(rows.last + 1, cols.last + 1);
+						const Sum* top_right = get_entry(rows.first, cols.last + 1);
+						const Sum* bottom_left = get_entry(rows.last + 1, cols.first);
+						const Sum* top_left = get_entry(rows.first, cols.first);
+						for (int ch = 0; ch < channels; ch++)
+						{
+							sums[ch] += bottom_right[ch] - top_right[ch] - bottom_left[ch] + top_left[ch];
+						}
+					}
+				}
+				set_average(pixels[i * stride + j], sums, area);
+			}
+		}
+	});
+}
+
+template <typename Pixel>
+static void blur_sat(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+					 const int kernel_size, const int threads, BlurWorkspace& workspace, BlurStats* stats)
+{
+	const auto* table = build_sat(pixels, image_width, image_height, stride, threads, workspace, stats);
+	blur_from_sat(table, pixels, image_width, image_height, stride, kernel_size, threads, workspace, stats);
+}
+
+template <typename Pixel>
+static void blur_reference(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+						   const int kernel_size, const int threads, BlurWorkspace& workspace, BlurStats* stats)
+{
+	using Sum = typename PixelSum<Pixel>::type;
+	const int pad = kernel_size / 2;
+
+	// Trivial unoptimized box blur algorithm version, on a padded copy of the image
+	const int padded_img_width = image_width + 2 * pad;
+	const size_t padded_img_size = static_cast<size_t>(padded_img_width) * (image_height + 2 * pad);
+	Pixel* padded_img = workspace.get_buffer<Pixel>(0, padded_img_size);
+	mirror_pad(pixels, image_width, image_height, stride, pad, padded_img);
+	if (stats)
+	{
+		stats->scratch_bytes += padded_img_size * sizeof(Pixel);
+	}
+	const int64_t area = static_cast<int64_t>(kernel_size) * kernel_size;
+	run_in_bands(image_height, threads, [&](int, int first_row, int last_row)
+	{
+		for (int i = first_row; i < last_row; i++)
+		{
+			for (int j = 0; j < image_width; j++)
+			{
+				// Pixel (i, j) is at (i + pad, j + pad) in the padded image, so its kernel starts at (i, j)
+				Sum sums[3] = {};
+				for (int ii = i; ii < i + kernel_size; ii++)
+				{
+					for (int jj = j; jj < j + kernel_size; jj++)
+					{
+						add_channels(padded_img[static_cast<ptrdiff_t>(ii) * padded_img_width + jj], sums);
+					}
+				}
+				set_average(pixels[i * stride + j], sums, area);
+			}
+		}
+	});
+}
+
+// Sizes of GAUSSIAN_PASSES box filters in a row approximating a Gaussian with the same variance of a single box of
+// kernel_size, sigma^2 = (kernel_size^2 - 1) / 12. The sizes are the two odd ones around the ideal one, mixed so
+// the variances add up as close as possible to the target (Kovesi, "Fast almost-Gaussian filtering").
+static const int GAUSSIAN_PASSES = 3;
+
+static void get_gaussian_box_sizes(const int kernel_size, int* sizes)
+{
+	const double variance = (static_cast<double>(kernel_size) * kernel_size - 1.0) / 12.0;
+	const int n = GAUSSIAN_PASSES;
+	int lower = static_cast<int>(std::floor(std::sqrt(12.0 * variance / n + 1.0)));
+	if (lower % 2 == 0)
+	{
+		lower--;
+	}
+	const int lower_count = static_cast<int>(std::round((12.0 * variance - n * lower * lower - 4.0 * n * lower - 3.0 * n) /
+														(-4.0 * lower - 4.0)));
+	for (int p = 0; p < n; p++)
+	{
+		sizes[p] = (p < lower_count ? lower : lower + 2);
+	}
+}
+
+// Row and column passes of the two pixel types, the vector ones for floats (picked at runtime) and the packed ones
+// for 8-bit words
+template <typename Pixel>
+struct BoxKernels;
+
+template <>
+struct BoxKernels<RGBA>
+{
+	static void blur_rows(const RGBA* src, ptrdiff_t src_stride, RGBA* dst, ptrdiff_t dst_stride, int rows, int width, int kernel_size)
+	{
+		get_blur_kernels().blur_rows(src, src_stride, dst, dst_stride, rows, width, kernel_size);
+	}
+
+	static void blur_cols(const RGBA* src, ptrdiff_t src_stride, RGBA* dst, ptrdiff_t dst_stride, int cols, int height, int kernel_size)
+	{
+		get_blur_kernels().blur_cols(src, src_stride, dst, dst_stride, cols, height, kernel_size);
+	}
+};
+
+template <>
+struct BoxKernels<float>
+{
+	static void blur_rows(const float* src, ptrdiff_t src_stride, float* dst, ptrdiff_t dst_stride, int rows, int width, int kernel_size)
+	{
+		get_blur_kernels().blur_plane_rows(src, src_stride, dst, dst_stride, rows, width, kernel_size);
+	}
+
+	static void blur_cols(const float* src, ptrdiff_t src_stride, float* dst, ptrdiff_t dst_stride, int cols, int height, int kernel_size)
+	{
+		get_blur_kernels().blur_plane_cols(src, src_stride, dst, dst_stride, cols, height, kernel_size);
+	}
+};
+
+template <>
+struct BoxKernels<uint8_t>
+{
+	static void blur_rows(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride, int rows, int width,
+						  int kernel_size)
+	{
+		blur_rows_gray(src, src_stride, dst, dst_stride, rows, width, kernel_size);
+	}
+
+	static void blur_cols(const uint8_t* src, ptrdiff_t src_stride, uint8_t* dst, ptrdiff_t dst_stride, int cols, int height,
+						  int kernel_size)
+	{
+		blur_cols_gray(src, src_stride, dst, dst_stride, cols, height, kernel_size);
+	}
+};
+
+template <>
+struct BoxKernels<uint32_t>
+{
+	static void blur_rows(const uint32_t* src, ptrdiff_t src_stride, uint32_t* dst, ptrdiff_t dst_stride, int rows, int width,
+						  int kernel_size)
+	{
+		blur_rows_packed(reinterpret_cast<const uint8_t*>(src), src_stride, reinterpret_cast<uint8_t*>(dst), dst_stride,
+						 rows, width, kernel_size);
+	}
+
+	static void blur_cols(const uint32_t* src, ptrdiff_t src_stride, uint32_t* dst, ptrdiff_t dst_stride, int cols, int height,
+						  int kernel_size)
+	{
+		blur_cols_packed(reinterpret_cast<const uint8_t*>(src), src_stride, reinterpret_cast<uint8_t*>(dst), dst_stride,
+						 cols, height, kernel_size);
+	}
+};
+
+// Box sizes of the passes of mode, returns how many they are
+static int get_pass_sizes(const int kernel_size, const BlurMode mode, int* kernel_sizes)
+{
+	if (mode == BlurMode::GAUSSIAN)
+	{
+		get_gaussian_box_sizes(kernel_size, kernel_sizes);
+		return GAUSSIAN_PASSES;
+	}
+	kernel_sizes[0] = kernel_size;
+	return 1;
+}
+
+// Reflect padding relative to the whole line of size pixels, position can be up to size - 1 past either edge
+static int mirror_index(const int position, const int size)
+{
+	if (position < 0)
+	{
+		return -position;
+	}
+	if (position >= size)
+	{
+		return 2 * size - 2 - position;
+	}
+	return position;
+}
+
+// Positions a pass needs to produce out, clamped to the line: the mirrored ones past the edges are inside it
+static Span get_halo_span(const Span& out, const int pad, const int size)
+{
+	return { std::max(0, out.first - pad), std::min(size - 1, out.last + pad) };
+}
+
+static int get_length(const Span& span)
+{
+	return span.last - span.first + 1;
+}
+
+// Source lines of a row pass producing the positions of out: rows lines of src (holding positions src_first on,
+// src_stride apart) copied in dst with their pad wide borders, mirrored at the edges of the image
+template <typename Pixel>
+static void fill_mirrored_lines(const Pixel* src, const ptrdiff_t src_stride, const int src_first, Pixel* dst,
+								const ptrdiff_t dst_stride, const int rows, const Span& out, const int pad, const int size)
+{
+	const int length = get_length(out) + 2 * pad;
+	for (int r = 0; r < rows; r++)
+	{
+		const Pixel* line = src + r * src_stride;
+		Pixel* dst_line = dst + r * dst_stride;
+		for (int t = 0; t < length; t++)
+		{
+			dst_line[t] = line[mirror_index(out.first - pad + t, size) - src_first];
+		}
+	}
+}
+
+// Same for a column pass over a strip of cols columns, the lines are the rows of the strip
+template <typename Pixel>
+static void fill_mirrored_strip(const Pixel* src, const ptrdiff_t src_stride, const int src_first, Pixel* strip,
+								const int cols, const Span& out, const int pad, const int size)
+{
+	const int length = get_length(out) + 2 * pad;
+	for (int t = 0; t < length; t++)
+	{
+		const Pixel* row = src + (mirror_index(out.first - pad + t, size) - src_first) * src_stride;
+		std::copy(row, row + cols, strip + static_cast<ptrdiff_t>(t) * STRIP_WIDTH);
+	}
+}
+
+// The separable passes restricted to roi. Working backwards from the rectangle, every pass needs the output of the
+// previous one over its own output plus its pad (clamped to the image, mirroring takes care of the rest): the
+// row passes run on the rows all the column passes will need, into a buffer of those rows by roi.width pixels,
+// and the column passes read it back and write the rectangle into the image.
+template <typename Pixel>
+static void blur_roi(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+					 const BlurRect& roi, const int* kernel_sizes, const int passes, const int threads, BlurWorkspace& workspace,
+					 BlurStats* stats)
+{
+	Span col_spans[GAUSSIAN_PASSES + 1];
+	Span row_spans[GAUSSIAN_PASSES + 1];
+	col_spans[passes] = { roi.x, roi.x + roi.width - 1 };
+	row_spans[passes] = { roi.y, roi.y + roi.height - 1 };
+	for (int p = passes - 1; p >= 0; p--)
+	{
+		col_spans[p] = get_halo_span(col_spans[p + 1], kernel_sizes[p] / 2, image_width);
+		row_spans[p] = get_halo_span(row_spans[p + 1], kernel_sizes[p] / 2, image_height);
+	}
+	const int max_pad = *std::max_element(kernel_sizes, kernel_sizes + passes) / 2;
+	const int halo_rows = get_length(row_spans[0]);
+	const size_t blurred_rows_size = static_cast<size_t>(halo_rows) * roi.width;
+	Pixel* blurred_rows = workspace.get_buffer<Pixel>(0, blurred_rows_size);
+	if (stats)
+	{
+		stats->scratch_bytes += blurred_rows_size * sizeof(Pixel);
+	}
+
+	{
+		ScopedTimer timer(stats ? &stats->blur_rows : nullptr);
+		const int line_width = get_length(col_spans[0]) + 2 * max_pad;
+		// Mirrored source lines, and the output of the passes before the last one
+		size_t band_size = 2 * static_cast<size_t>(ROW_CHUNK) * line_width;
+		Pixel* scratch = get_band_buffers<Pixel>(workspace, 1, halo_rows, threads, band_size, stats);
+		run_in_bands(halo_rows, threads, [&](int band, int first_row, int last_row)
+		{
+			Pixel* src_lines = scratch + band * band_size;
+			Pixel* passed_lines = src_lines + static_cast<ptrdiff_t>(ROW_CHUNK) * line_width;
+			for (int i = first_row; i < last_row; i += ROW_CHUNK)
+			{
+				const int rows = std::min(ROW_CHUNK, last_row - i);
+				const Pixel* src = pixels + (row_spans[0].first + i) * stride;
+				ptrdiff_t src_stride = stride;
+				int src_first = 0;
+				for (int p = 0; p < passes; p++)
+				{
+					const int pad = kernel_sizes[p] / 2;
+					const Span& out = col_spans[p + 1];
+					fill_mirrored_lines(src, src_stride, src_first, src_lines, line_width, rows, out, pad, image_width);
+					if (p == passes - 1)
+					{
+						BoxKernels<Pixel>::blur_rows(src_lines, line_width, blurred_rows + static_cast<ptrdiff_t>(i) * roi.width,
+													 roi.width, rows, roi.width, kernel_sizes[p]);
+					}
+					else
+					{
+						BoxKernels<Pixel>::blur_rows(src_lines, line_width, passed_lines, line_width, rows, get_length(out), kernel_sizes[p]);
+						src = passed_lines;
+						src_stride = line_width;
+						src_first = out.first;
+					}
+				}
+			}
+		});
+	}
+	{
+		ScopedTimer timer(stats ? &stats->blur_cols : nullptr);
+		const int strip_height = halo_rows + 2 * max_pad;
+		size_t band_size = 2 * static_cast<size_t>(STRIP_WIDTH) * strip_height;
+		Pixel* scratch = get_band_buffers<Pixel>(workspace, 1, roi.width, threads, band_size, stats);
+		run_in_bands(roi.width, threads, [&](int band, int first_col, int last_col)
+		{
+			Pixel* src_strip = scratch + band * band_size;
+			Pixel* passed_strip = src_strip + static_cast<ptrdiff_t>(STRIP_WIDTH) * strip_height;
+			for (int j = first_col; j < last_col; j += STRIP_WIDTH)
+			{
+				const int cols = std::min(STRIP_WIDTH, last_col - j);
+				const Pixel* src = blurred_rows + j;
+				ptrdiff_t src_stride = roi.width;
+				int src_first = row_spans[0].first;
+				for (int p = 0; p < passes; p++)
+				{
+					const Span& out = row_spans[p + 1];
+					fill_mirrored_strip(src, src_stride, src_first, src_strip, cols, out, kernel_sizes[p] / 2, image_height);
+					if (p == passes - 1)
+					{
+						BoxKernels<Pixel>::blur_cols(src_strip, STRIP_WIDTH, pixels + roi.y * stride + roi.x + j, stride,
+													 cols, roi.height, kernel_sizes[p]);
+					}
+					else
+					{
+						BoxKernels<Pixel>::blur_cols(src_strip, STRIP_WIDTH, passed_strip, STRIP_WIDTH, cols, get_length(out),
+													 kernel_sizes[p]);
+						src = passed_strip;
+						src_stride = STRIP_WIDTH;
+						src_first = out.first;
+					}
+				}
+			}
+		});
+	}
+}
+
+template <typename Pixel>
+static void blur_rows_region(const Pixel* src, const ptrdiff_t src_stride, Pixel* dst, const ptrdiff_t dst_stride,
+							 const int image_width, const BlurRect& region, const int kernel_size, const int threads,
+							 BlurWorkspace& workspace)
+{
+	const int pad = kernel_size / 2;
+	const int line_width = region.width + 2 * pad;
+	const Span cols = { region.x, region.x + region.width - 1 };
+	size_t band_size = static_cast<size_t>(ROW_CHUNK) * line_width;
+	Pixel* scratch = get_band_buffers<Pixel>(workspace, 0, region.height, threads, band_size, nullptr);
+	run_in_bands(region.height, threads, [&](int band, int first_row, int last_row)
+	{
+		Pixel* lines = scratch + band * band_size;
+		for (int i = region.y + first_row; i < region.y + last_row; i += ROW_CHUNK)
+		{
+			const int rows = std::min(ROW_CHUNK, region.y + last_row - i);
+			fill_mirrored_lines(src + i * src_stride, src_stride, 0, lines, line_width, rows, cols, pad, image_width);
+			BoxKernels<Pixel>::blur_rows(lines, line_width, dst + i * dst_stride + region.x, dst_stride,
+										 rows, region.width, kernel_size);
+		}
+	});
+}
+
+template <typename Pixel>
+static void blur_cols_region(const Pixel* src, const ptrdiff_t src_stride, Pixel* dst, const ptrdiff_t dst_stride,
+							 const int image_height, const BlurRect& region, const int kernel_size, const int threads,
+							 BlurWorkspace& workspace)
+{
+	const int pad = kernel_size / 2;
+	const Span rows = { region.y, region.y + region.height - 1 };
+	size_t band_size = static_cast<size_t>(STRIP_WIDTH) * (region.height + 2 * pad);
+	Pixel* scratch = get_band_buffers<Pixel>(workspace, 0, region.width, threads, band_size, nullptr);
+	run_in_bands(region.width, threads, [&](int band, int first_col, int last_col)
+	{
+		Pixel* strip = scratch + band * band_size;
+		for (int j = region.x + first_col; j < region.x + last_col; j += STRIP_WIDTH)
+		{
+			const int cols = std::min(STRIP_WIDTH, region.x + last_col - j);
+			fill_mirrored_strip(src + j, src_stride, 0, strip, cols, rows, pad, image_height);
+			BoxKernels<Pixel>::blur_cols(strip, STRIP_WIDTH, dst + region.y * dst_stride + j, dst_stride,
+										 cols, region.height, kernel_size);
+		}
+	});
+}
+
+// Used by the calls that don't bring a workspace of their own, so that a thread blurring image after image
+// doesn't allocate either
+static BlurWorkspace& get_thread_workspace()
+{
+	thread_local BlurWorkspace workspace;
+	return workspace;
+}
+
+static bool is_valid_view(const ImageView& image)
+{
+	const ptrdiff_t pixel_size = static_cast<ptrdiff_t>(get_pixel_size(image.layout));
+	return image.data && image.stride % pixel_size == 0 && image.stride >= image.width * pixel_size;
+}
+
+// Checks shared by the region passes
+static void check_region_views(const ImageView& src, const ImageView& dst, const BlurRect& region, const int kernel_size,
+							   const int threads)
+{
+	if (!is_valid_view(src) || !is_valid_view(dst) || src.width != dst.width || src.height != dst.height ||
+		src.layout != dst.layout)
+	{
+		throw std::invalid_argument("Invalid image views (same size and layout needed, strides of whole pixels)");
+	}
+	if (region.x < 0 || region.y < 0 || region.width < 0 || region.height < 0 ||
+		region.x + region.width > src.width || region.y + region.height > src.height)
+	{
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "Region %d,%d,%d,%d is not inside the %dx%d image",
+				 region.x, region.y, region.width, region.height, src.width, src.height);
+		throw std::invalid_argument(buffer);
+	}
+	if (kernel_size < 1 || kernel_size % 2 == 0 || kernel_size / 2 >= std::min(src.width, src.height))
+	{
+		throw std::invalid_argument("Invalid kernel size (it needs to be odd and smaller than the image)");
+	}
+	if (threads < 1)
+	{
+		throw std::invalid_argument("Invalid thread count (it needs to be at least 1)");
+	}
+}
+
+// Planar views blur the color planes one at a time, the alpha plane (when there's one) only needs to be opaque
+static const int COLOR_PLANES = 3;
+
+static void set_opaque(const ImageView& image, const BlurRect& rect)
+{
+	if (image.layout != PixelLayout::PLANAR_RGBA_F32)
+	{
+		return;
+	}
+	const ImageView alpha(image.get_plane(COLOR_PLANES), image.width, image.height, image.layout, image.stride);
+	for (int i = rect.y; i < rect.y + rect.height; i++)
+	{
+		float* row = reinterpret_cast<float*>(alpha.get_row(i)) + rect.x;
+		std::fill(row, row + rect.width, 1.f);
+	}
+}
+
+void blur_rows_region(const ImageView& src, const ImageView& dst, const BlurRect& region, int kernel_size, int threads,
+					  BlurWorkspace* workspace)
+{
+	check_region_views(src, dst, region, kernel_size, threads);
+	BlurWorkspace& scratch = workspace ? *workspace : get_thread_workspace();
+	const ptrdiff_t pixel_size = static_cast<ptrdiff_t>(get_pixel_size(src.layout));
+	if (src.layout == PixelLayout::RGBA_F32)
+	{
+		blur_rows_region(reinterpret_cast<const RGBA*>(src.data), src.stride / pixel_size, reinterpret_cast<RGBA*>(dst.data),
+						 dst.stride / pixel_size, src.width, region, kernel_size, threads, scratch);
+	}
+	else if (get_plane_count(src.layout) > 1)
+	{
+		for (int p = 0; p < COLOR_PLANES; p++)
+		{
+			blur_rows_region(reinterpret_cast<const float*>(src.get_plane(p)), src.stride / pixel_size,
+							 reinterpret_cast<float*>(dst.get_plane(p)), dst.stride / pixel_size, src.width, region, kernel_size,
+							 threads, scratch);
+		}
+		set_opaque(dst, region);
+	}
+	else if (src.layout == PixelLayout::GRAY8)
+	{
+		blur_rows_region(reinterpret_cast<const uint8_t*>(src.data), src.stride, reinterpret_cast<uint8_t*>(dst.data),
+						 dst.stride, src.width, region, kernel_size, threads, scratch);
+	}
+	else
+	{
+		blur_rows_region(reinterpret_cast<const uint32_t*>(src.data), src.stride / pixel_size, reinterpret_cast<uint32_t*>(dst.data),
+						 dst.stride / pixel_size, src.width, region, kernel_size, threads, scratch);
+	}
+}
+
+void blur_cols_region(const ImageView& src, const ImageView& dst, const BlurRect& region, int kernel_size, int threads,
+					  BlurWorkspace* workspace)
+{
+	check_region_views(src, dst, region, kernel_size, threads);
+	BlurWorkspace& scratch = workspace ? *workspace : get_thread_workspace();
+	const ptrdiff_t pixel_size = static_cast<ptrdiff_t>(get_pixel_size(src.layout));
+	if (src.layout == PixelLayout::RGBA_F32)
+	{
+		blur_cols_region(reinterpret_cast<const RGBA*>(src.data), src.stride / pixel_size, reinterpret_cast<RGBA*>(dst.data),
+						 dst.stride / pixel_size, src.height, region, kernel_size, threads, scratch);
+	}
+	else if (get_plane_count(src.layout) > 1)
+	{
+		for (int p = 0; p < COLOR_PLANES; p++)
+		{
+			blur_cols_region(reinterpret_cast<const float*>(src.get_plane(p)), src.stride / pixel_size,
+							 reinterpret_cast<float*>(dst.get_plane(p)), dst.stride / pixel_size, src.height, region, kernel_size,
+							 threads, scratch);
+		}
+		set_opaque(dst, region);
+	}
+	else if (src.layout == PixelLayout::GRAY8)
+	{
+		blur_cols_region(reinterpret_cast<const uint8_t*>(src.data), src.stride, reinterpret_cast<uint8_t*>(dst.data),
+						 dst.stride, src.height, region, kernel_size, threads, scratch);
+	}
+	else
+	{
+		blur_cols_region(reinterpret_cast<const uint32_t*>(src.data), src.stride / pixel_size, reinterpret_cast<uint32_t*>(dst.data),
+						 dst.stride / pixel_size, src.height, region, kernel_size, threads, scratch);
+	}
+}
+
+// Pixel is RGBA for float views, a single float for the planes of planar ones, a byte for gray ones and a packed
+// 8-bit word for the others, stride is in pixels
+template <typename Pixel>
+static void blur_pixels(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+						const BlurRect& roi, const int kernel_size, const int threads, const BlurMode mode, BlurWorkspace& workspace,
+						BlurStats* stats)
+{
+	int kernel_sizes[GAUSSIAN_PASSES];
+	const int passes = get_pass_sizes(kernel_size, mode, kernel_sizes);
+	if (roi.width < image_width || roi.height < image_height)
+	{
+		if (mode != BlurMode::BOX && mode != BlurMode::GAUSSIAN)
+		{
+			throw std::invalid_argument("Only the box and gaussian modes can blur a region of the image");
+		}
+		blur_roi(pixels, image_width, image_height, stride, roi, kernel_sizes, passes, threads, workspace, stats);
+		return;
+	}
+
+	if (mode == BlurMode::SAT)
+	{
+		// Box blur with precomputed SAT (Summed Area Table) optimization
+		blur_sat(pixels, image_width, image_height, stride, kernel_size, threads, workspace, stats);
+		return;
+	}
+	if (mode == BlurMode::REFERENCE)
+	{
+		blur_reference(pixels, image_width, image_height, stride, kernel_size, threads, workspace, stats);
+		return;
+	}
+
+	// Box blur with separated filter (spanning rows and columns separately) and moving average optimization,
+	// every row (and later every column) is filtered independently so the passes are split in bands across
+	// threads, the only synchronization point needed is the join between the two passes
+	blur_in_place(pixels, image_width, image_height, stride, kernel_sizes, passes, threads, BoxKernels<Pixel>::blur_rows,
+				  BoxKernels<Pixel>::blur_cols, workspace, stats);
+}
+
+// Approximate mode. Low resolution pixel (I, J) is the average of the block of scale x scale pixels from
+// (I * scale, J * scale), clipped to the image (the last ones can be smaller), and it's taken to be the value at the
+// center of the block when interpolating back.
+int get_approximate_blur_scale(int width, int height, float factor, float tolerance)
+{
+	if (!(tolerance > 0.f && tolerance <= 0.25f))
+	{
+		throw std::invalid_argument("Invalid tolerance (it needs to be in the 0 < t <= 0.25 range)");
+	}
+	const int kernel_size = get_blur_kernel_size(width, height, factor);
+	int scale = 1;
+	while (2 * scale <= tolerance * kernel_size)
+	{
+		scale *= 2;
+	}
+	return scale;
+}
+
+// The block average is a box of scale pixels already and the interpolation a tent 2 * scale wide, the kernel of the
+// low resolution blur only makes up the rest of the variance of the full resolution box: scale^2 (size^2 - 1) / 12
+// + (scale^2 - 1) / 12 + scale^2 / 6 = (kernel_size^2 - 1) / 12, rounded to the nearest odd size
+static int get_low_kernel_size(const int kernel_size, const int scale)
+{
+	const double ratio = static_cast<double>(kernel_size) / scale;
+	const double size = std::sqrt(std::max(1.0, ratio * ratio - 2.0));
+	return 2 * static_cast<int>(std::round((size - 1.0) / 2.0)) + 1;
+}
+
+template <typename Pixel>
+static void downsample(const Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+					   const int scale, Pixel* low, const int low_width, const int low_height, const int threads,
+					   BlurWorkspace& workspace, BlurStats* stats)
+{
+	using Sum = typename PixelSum<Pixel>::type;
+	const int channels = PixelSum<Pixel>::channels;
+	// A row of sums per band, the rows of a block are added one after the other so they're read in order
+	size_t band_size = static_cast<size_t>(channels) * low_width;
+	Sum* scratch = get_band_buffers<Sum>(workspace, 0, low_height, threads, band_size, stats);
+	run_in_bands(low_height, threads, [&](int band, int first_row, int last_row)
+	{
+		Sum* sums = scratch + band * band_size;
+		for (int i = first_row; i < last_row; i++)
+		{
+			const int rows = std::min(scale, image_height - i * scale);
+			std::fill(sums, sums + channels * low_width, Sum(0));
+			for (int r = 0; r < rows; r++)
+			{
+				const Pixel* row = pixels + (i * scale + r) * stride;
+				for (int j = 0; j < low_width; j++)
+				{
+					// Summed apart first, so the sums of the block stay in registers
+					const int cols = std::min(scale, image_width - j * scale);
+					Sum block[3] = {};
+					for (int c = 0; c < cols; c++)
+					{
+						add_channels(row[j * scale + c], block);
+					}
+					for (int ch = 0; ch < channels; ch++)
+					{
+						sums[channels * j + ch] += block[ch];
+					}
+				}
+			}
+			for (int j = 0; j < low_width; j++)
+			{
+				const int64_t area = static_cast<int64_t>(rows) * std::min(scale, image_width - j * scale);
+				set_average(low[static_cast<ptrdiff_t>(i) * low_width + j], sums + channels * j, area);
+			}
+		}
+	});
+}
+
+// Low resolution pixels a full resolution position is interpolated from, with the weight of the second one (and the
+// same in 1/256 units for the integer engine). Past the first and the last centers it's the nearest one.
+struct Tap
+{
+	int first;
+	int second;
+	float weight;
+	int fixed_weight;
+};
+
+static void get_taps(const int size, const int scale, const int low_size, Tap* taps)
+{
+	for (int x = 0; x < size; x++)
+	{
+		const float position = (x + 0.5f) / scale - 0.5f;
+		Tap& tap = taps[x];
+		tap.first = static_cast<int>(std::floor(position));
+		tap.weight = position - tap.first;
+		if (position <= 0.f || tap.first >= low_size - 1)
+		{
+			tap.first = std::min(std::max(tap.first, 0), low_size - 1);
+			tap.weight = 0.f;
+		}
+		tap.second = std::min(tap.first + 1, low_size - 1);
+		tap.fixed_weight = static_cast<int>(std::lround(tap.weight * 256.f));
+	}
+}
+
+// The interpolation is separable: low resolution rows are interpolated along x into full width lines first, then
+// every output row is interpolated between two of those. The integer engine keeps the lines in 8.8 fixed point, so
+// it only rounds once. The lines are opaque already (alpha interpolates to itself), so the second step is the
+// same for every channel and goes over them as a plain array.
+struct FixedPixel
+{
+	uint16_t channels[4];
+};
+template <typename Pixel>
+struct Interpolated;
+
+template <>
+struct Interpolated<RGBA>
+{
+	using type = RGBA;
+};
+
+template <>
+struct Interpolated<float>
+{
+	using type = float;
+};
+
+template <>
+struct Interpolated<uint32_t>
+{
+	using type = FixedPixel;
+};
+
+template <>
+struct Interpolated<uint8_t>
+{
+	using type = uint16_t;
+};
+
+static float interpolate(const float first, const float second, const float weight)
+{
+	return first + (second - first) * weight;
+}
+
+static void interpolate_row(const float* low, const Tap* taps, const int width, float* line)
+{
+	for (int x = 0; x < width; x++)
+	{
+		line[x] = interpolate(low[taps[x].first], low[taps[x].second], taps[x].weight);
+	}
+}
+
+static void interpolate_rows(const float* top, const float* bottom, const Tap& tap, const int width, float* out)
+{
+	for (int x = 0; x < width; x++)
+	{
+		out[x] = interpolate(top[x], bottom[x], tap.weight);
+	}
+}
+
+static void interpolate_row(const RGBA* low, const Tap* taps, const int width, RGBA* line)
+{
+	for (int x = 0; x < width; x++)
+	{
+		const RGBA& first = low[taps[x].first];
+		const RGBA& second = low[taps[x].second];
+		const float weight = taps[x].weight;
+		line[x] = RGBA(interpolate(first.red, second.red, weight), interpolate(first.green, second.green, weight),
+					   interpolate(first.blue, second.blue, weight), 1.f);
+	}
+}
+
+static void interpolate_rows(const RGBA* top, const RGBA* bottom, const Tap& tap, const int width, RGBA* out)
+{
+	interpolate_rows(reinterpret_cast<const float*>(top), reinterpret_cast<const float*>(bottom), tap, 4 * width,
+					 reinterpret_cast<float*>(out));
+}
+
+static void interpolate_row(const uint32_t* low, const Tap* taps, const int width, FixedPixel* line)
+{
+	for (int x = 0; x < width; x++)
+	{
+		const uint8_t* first = reinterpret_cast<const uint8_t*>(low + taps[x].first);
+		const uint8_t* second = reinterpret_cast<const uint8_t*>(low + taps[x].second);
+		const int weight = taps[x].fixed_weight;
+		for (int c = 0; c < 3; c++)
+		{
+			line[x].channels[c] = static_cast<uint16_t>(first[c] * (256 - weight) + second[c] * weight);
+		}
+		line[x].channels[3] = 0xFF00;
+	}
+}
+
+static void interpolate_rows(const FixedPixel* top, const FixedPixel* bottom, const Tap& tap, const int width, uint32_t* out)
+{
+	const uint16_t* first = top->channels;
+	const uint16_t* second = bottom->channels;
+	uint8_t* bytes = reinterpret_cast<uint8_t*>(out);
+	const uint32_t weight = static_cast<uint32_t>(tap.fixed_weight);
+	for (int k = 0; k < 4 * width; k++)
+	{
+		bytes[k] = static_cast<uint8_t>((first[k] * (256 - weight) + second[k] * weight + 32768) >> 16);
+	}
+}
+
+static void interpolate_row(const uint8_t* low, const Tap* taps, const int width, uint16_t* line)
+{
+	for (int x = 0; x < width; x++)
+	{
+		const int weight = taps[x].fixed_weight;
+		line[x] = static_cast<uint16_t>(low[taps[x].first] * (256 - weight) + low[taps[x].second] * weight);
+	}
+}
+
+static void interpolate_rows(const uint16_t* top, const uint16_t* bottom, const Tap& tap, const int width, uint8_t* out)
+{
+	const uint32_t weight = static_cast<uint32_t>(tap.fixed_weight);
+	for (int x = 0; x < width; x++)
+	{
+		out[x] = static_cast<uint8_t>((top[x] * (256 - weight) + bottom[x] * weight + 32768) >> 16);
+	}
+}
+
+template <typename Pixel>
+static void upsample(const Pixel* low, const int low_width, const int low_height, const int scale, Pixel* pixels,
+					 const int image_width, const int image_height, const ptrdiff_t stride, const int threads,
+					 BlurWorkspace& workspace, BlurStats* stats)
+{
+	using Line = typename Interpolated<Pixel>::type;
+	Tap* col_taps = workspace.get_buffer<Tap>(2, static_cast<size_t>(image_width) + image_height);
+	Tap* row_taps = col_taps + image_width;
+	get_taps(image_width, scale, low_width, col_taps);
+	get_taps(image_height, scale, low_height, row_taps);
+
+	// Two interpolated lines per band, low resolution row I goes in line I % 2 so the two rows an output row is
+	// between never take the same one, and each one is interpolated once as the band goes down
+	size_t band_size = 2 * static_cast<size_t>(image_width);
+	Line* scratch = get_band_buffers<Line>(workspace, 0, image_height, threads, band_size, stats);
+	if (stats)
+	{
+		stats->scratch_bytes += (static_cast<size_t>(image_width) + image_height) * sizeof(Tap);
+	}
+	run_in_bands(image_height, threads, [&](int band, int first_row, int last_row)
+	{
+		Line* lines = scratch + band * band_size;
+		int line_rows[2] = { -1, -1 };
+		auto get_line = [&](const int row)
+		{
+			Line* line = lines + (row % 2) * image_width;
+			if (line_rows[row % 2] != row)
+			{
+				interpolate_row(low + static_cast<ptrdiff_t>(row) * low_width, col_taps, image_width, line);
+				line_rows[row % 2] = row;
+			}
+			return line;
+		};
+		for (int i = first_row; i < last_row; i++)
+		{
+			const Tap& tap = row_taps[i];
+			const Line* top = get_line(tap.first);
+			const Line* bottom = get_line(tap.second);
+			interpolate_rows(top, bottom, tap, image_width, pixels + i * stride);
+		}
+	});
+}
+
+template <typename Pixel>
+static void blur_approximate(Pixel* pixels, const int image_width, const int image_height, const ptrdiff_t stride,
+							 const int kernel_size, const int scale, const int threads, BlurWorkspace& workspace, BlurStats* stats)
+{
+	const int low_width = (image_width + scale - 1) / scale;
+	const int low_height = (image_height + scale - 1) / scale;
+	const size_t low_size = static_cast<size_t>(low_width) * low_height;
+	Pixel* low = workspace.get_buffer<Pixel>(1, low_size);
+	if (stats)
+	{
+		stats->scratch_bytes += low_size * sizeof(Pixel);
+	}
+
+	downsample(pixels, image_width, image_height, stride, scale, low, low_width, low_height, threads, workspace, stats);
+	const int low_kernel_size = get_low_kernel_size(kernel_size, scale);
+	blur_in_place(low, low_width, low_height, low_width, &low_kernel_size, 1, threads, BoxKernels<Pixel>::blur_rows,
+				  BoxKernels<Pixel>::blur_cols, workspace, stats);
+	upsample(low, low_width, low_height, scale, pixels, image_width, image_height, stride, threads, workspace, stats);
+}
+
+void blur_image_approximate(const ImageView& image, float factor, float tolerance, int threads, BlurStats* stats,
+							BlurWorkspace* workspace)
+{
+	const int scale = get_approximate_blur_scale(image.width, image.height, factor, tolerance);
+	if (scale == 1)
+	{
+		blur_image(image, factor, threads, BlurMode::BOX, stats, workspace);
+		return;
+	}
+	if (threads < 1)
+	{
+		throw std::invalid_argument("Invalid thread count (it needs to be at least 1)");
+	}
+	if (!is_valid_view(image))
+	{
+		throw std::invalid_argument("Invalid image view (the stride needs to be a whole number of pixels, at least a row)");
+	}
+	const int kernel_size = get_blur_kernel_size(image.width, image.height, factor);
+	if (stats)
+	{
+		stats->kernel_size = kernel_size;
+		stats->pad = kernel_size / 2;
+		stats->scale = scale;
+	}
+
+	ScopedTimer timer(stats ? &stats->blur : nullptr);
+	BlurWorkspace& scratch = workspace ? *workspace : get_thread_workspace();
+	const ptrdiff_t pixel_size = static_cast<ptrdiff_t>(get_pixel_size(image.layout));
+	if (image.layout == PixelLayout::RGBA_F32)
+	{
+		blur_approximate(reinterpret_cast<RGBA*>(image.data), image.width, image.height, image.stride / pixel_size,
+						 kernel_size, scale, threads, scratch, stats);
+	}
+	else if (get_plane_count(image.layout) > 1)
+	{
+		const size_t scratch_bytes = stats ? stats->scratch_bytes : 0;
+		for (int p = 0; p < COLOR_PLANES; p++)
+		{
+			blur_approximate(reinterpret_cast<float*>(image.get_plane(p)), image.width, image.height, image.stride / pixel_size,
+							 kernel_size, scale, threads, scratch, stats);
+		}
+		if (stats)
+		{
+			stats->scratch_bytes = scratch_bytes + (stats->scratch_bytes - scratch_bytes) / COLOR_PLANES;
+		}
+		set_opaque(image, BlurRect{ 0, 0, image.width, image.height });
+	}
+	else if (image.layout == PixelLayout::GRAY8)
+	{
+		blur_approximate(image.data, image.width, image.height, image.stride, kernel_size, scale, threads, scratch, stats);
+	}
+	else
+	{
+		blur_approximate(reinterpret_cast<uint32_t*>(image.data), image.width, image.height, image.stride / pixel_size,
+						 kernel_size, scale, threads, scratch, stats);
+	}
+}
+
+void blur_image(const ImageView& image, float factor, int threads, BlurMode mode, BlurStats* stats,
+				BlurWorkspace* workspace)
+{
+	blur_image(image, BlurRect{ 0, 0, image.width, image.height }, factor, threads, mode, stats, workspace);
+}
+
+void blur_image(const ImageView& image, const BlurRect& roi, float factor, int threads, BlurMode mode, BlurStats* stats,
+				BlurWorkspace* workspace)
+{
+	if (mode == BlurMode::APPROXIMATE && roi.x == 0 && roi.y == 0 && roi.width == image.width && roi.height == image.height)
+	{
+		blur_image_approximate(image, factor, DEFAULT_BLUR_TOLERANCE, threads, stats, workspace);
+		return;
+	}
+
+	// The kernel size depends on the whole image, the rectangle blurs exactly like it does in there
+	const int kernel_size = get_blur_kernel_size(image.width, image.height, factor);
+	if (threads < 1)
+	{
+		throw std::invalid_argument("Invalid thread count (it needs to be at least 1)");
+	}
+	if (roi.x < 0 || roi.y < 0 || roi.width < 0 || roi.height < 0 ||
+		roi.x + roi.width > image.width || roi.y + roi.height > image.height)
+	{
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "Region %d,%d,%d,%d is not inside the %dx%d image",
+				 roi.x, roi.y, roi.width, roi.height, image.width, image.height);
+		throw std::invalid_argument(buffer);
+	}
+	if (stats)
+	{
+		stats->kernel_size = std::max(0, kernel_size);
+		stats->pad = std::max(0, kernel_size) / 2;
+		stats->scale = 1;
+	}
+
+	if (kernel_size <= 0 || roi.width == 0 || roi.height == 0)
+	{
+		return;
+	}
+
+	const ptrdiff_t pixel_size = static_cast<ptrdiff_t>(get_pixel_size(image.layout));
+	if (!is_valid_view(image))
+	{
+		throw std::invalid_argument("Invalid image view (the stride needs to be a whole number of pixels, at least a row)");
+	}
+
+	ScopedTimer timer(stats ? &stats->blur : nullptr);
+	BlurWorkspace& scratch = workspace ? *workspace : get_thread_workspace();
+	// BGRA8 and RGBA8 blur the same way, alpha is the 4th byte in both
+	if (image.layout == PixelLayout::RGBA_F32)
+	{
+		blur_pixels(reinterpret_cast<RGBA*>(image.data), image.width, image.height, image.stride / pixel_size,
+					roi, kernel_size, threads, mode, scratch, stats);
+	}
+	else if (get_plane_count(image.layout) > 1)
+	{
+		const size_t scratch_bytes = stats ? stats->scratch_bytes : 0;
+		for (int p = 0; p < COLOR_PLANES; p++)
+		{
+			blur_pixels(reinterpret_cast<float*>(image.get_plane(p)), image.width, image.height, image.stride / pixel_size,
+						roi, kernel_size, threads, mode, scratch, stats);
+		}
+		if (stats)
+		{
+			// The planes take turns with the same scratch buffers
+			stats->scratch_bytes = scratch_bytes + (stats->scratch_bytes - scratch_bytes) / COLOR_PLANES;
+		}
+		set_opaque(image, roi);
+	}
+	else if (image.layout == PixelLayout::GRAY8)
+	{
+		blur_pixels(image.data, image.width, image.height, image.stride, roi, kernel_size, threads, mode, scratch, stats);
+	}
+	else
+	{
+		blur_pixels(reinterpret_cast<uint32_t*>(image.data), image.width, image.height, image.stride / pixel_size,
+					roi, kernel_size, threads, mode, scratch, stats);
+	}
+}
+
+// Copies the pixels of src into dst, same size and layout
+static void copy_pixels(const ImageView& src, const ImageView& dst)
+{
+	const size_t row_bytes = static_cast<size_t>(src.width) * get_pixel_size(src.layout);
+	for (int p = 0; p < get_plane_count(src.layout); p++)
+	{
+		for (int i = 0; i < src.height; i++)
+		{
+			memcpy(dst.get_plane(p) + i * dst.stride, src.get_plane(p) + i * src.stride, row_bytes);
+		}
+	}
+}
+
+// One table of the plane of source, every target with a kernel gets its blur from it
+template <typename Pixel>
+static void blur_sat_multi(const ImageView& source, const int plane, const std::vector<ImageView>& targets,
+						   const std::vector<int>& kernel_sizes, const int threads, BlurWorkspace& workspace, BlurStats* stats)
+{
+	const ptrdiff_t pixel_size = sizeof(Pixel);
+	const auto* table = build_sat(reinterpret_cast<const Pixel*>(source.get_plane(plane)), source.width, source.height,
+								  source.stride / pixel_size, threads, workspace, stats);
+	bool counted = false;
+	for (size_t k = 0; k < targets.size(); k++)
+	{
+		if (kernel_sizes[k] > 0)
+		{
+			// The spans are remade for every kernel size in the same buffers
+			blur_from_sat(table, reinterpret_cast<Pixel*>(targets[k].get_plane(plane)), source.width, source.height,
+						  targets[k].stride / pixel_size, kernel_sizes[k], threads, workspace, counted ? nullptr : stats);
+			counted = true;
+		}
+	}
+}
+
+// A target of the box and gaussian modes, with the box sizes of its passes (stride in pixels)
+template <typename Pixel>
+struct MultiTarget
+{
+	Pixel* pixels;
+	ptrdiff_t stride;
+	int kernel_sizes[GAUSSIAN_PASSES];
+};
+
+// The row passes of every target at once. Each chunk of source rows is copied and mirrored a single time, as wide
+// as the largest pad, and every kernel reads it from its own offset: reflect padding doesn't depend on how wide it
+// is. The later gaussian passes get two more chunks to ping-pong between.
+template <typename Pixel, typename RowsKernel>
+static void blur_rows_multi(const Pixel* source, const ptrdiff_t source_stride, const std::vector<MultiTarget<Pixel>>& targets,
+							const int image_width, const int image_height, const int passes, const int threads,
+							RowsKernel blur_rows, BlurWorkspace& workspace, BlurStats* stats)
+{
+	int source_pad = 0;
+	int max_pad = 0;
+	for (const MultiTarget<Pixel>& target : targets)
+	{
+		source_pad = std::max(source_pad, target.kernel_sizes[0] / 2);
+		max_pad = std::max(max_pad, *std::max_element(target.kernel_sizes, target.kernel_sizes + passes) / 2);
+	}
+
+	const int line_width = image_width + 2 * max_pad;
+	const size_t chunk_size = static_cast<size_t>(ROW_CHUNK) * line_width;
+	size_t band_size = (passes > 1 ? 3 : 1) * chunk_size;
+	Pixel* scratch = get_band_buffers<Pixel>(workspace, 0, image_height, threads, band_size, stats);
+	run_in_bands(image_height, threads, [&](int band, int first_row, int last_row)
+	{
+		Pixel* lines = scratch + band * band_size;
+		for (int i = first_row; i < last_row; i += ROW_CHUNK)
+		{
+			const int rows = std::min(ROW_CHUNK, last_row - i);
+			for (int r = 0; r < rows; r++)
+			{
+				const Pixel* row = source + (i + r) * source_stride;
+				Pixel* line = lines + static_cast<ptrdiff_t>(r) * line_width;
+				std::copy(row, row + image_width, line + source_pad);
+				mirror_line(line, image_width, source_pad);
+			}
+			for (const MultiTarget<Pixel>& target : targets)
+			{
+				const Pixel* src = lines + (source_pad - target.kernel_sizes[0] / 2);
+				for (int p = 0; p < passes - 1; p++)
+				{
+					Pixel* dst = lines + (p % 2 + 1) * chunk_size;
+					const int next_pad = target.kernel_sizes[p + 1] / 2;
+					blur_rows(src, line_width, dst + next_pad, line_width, rows, image_width, target.kernel_sizes[p]);
+					for (int r = 0; r < rows; r++)
+					{
+						mirror_line(dst + static_cast<ptrdiff_t>(r) * line_width, image_width, next_pad);
+					}
+					src = dst;
+				}
+				blur_rows(src, line_width, target.pixels + i * target.stride, target.stride, rows, image_width,
+						  target.kernel_sizes[passes - 1]);
+			}
+		}
+	});
+}
+
+// The column passes of the targets have nothing in common, but the strips of all of them are handed out together
+// so that the threads work on every target at the same time
+template <typename Pixel, typename ColsKernel>
+static void blur_cols_multi(const std::vector<MultiTarget<Pixel>>& targets, const int image_width, const int image_height,
+							const int passes, const int threads, ColsKernel blur_cols, BlurWorkspace& workspace, BlurStats* stats)
+{
+	int max_pad = 0;
+	for (const MultiTarget<Pixel>& target : targets)
+	{
+		max_pad = std::max(max_pad, *std::max_element(target.kernel_sizes, target.kernel_sizes + passes) / 2);
+	}
+
+	const size_t strip_size = static_cast<size_t>(STRIP_WIDTH) * (image_height + 2 * max_pad);
+	const int strips = (image_width + STRIP_WIDTH - 1) / STRIP_WIDTH;
+	const int count = strips * static_cast<int>(targets.size());
+	size_t band_size = (passes > 1 ? 2 : 1) * strip_size;
+	Pixel* scratch = get_band_buffers<Pixel>(workspace, 0, count, threads, band_size, stats);
+	run_in_bands(count, threads, [&](int band, int first, int last)
+	{
+		for (int s = first; s < last; s++)
+		{
+			const MultiTarget<Pixel>& target = targets[s / strips];
+			const int j = (s % strips) * STRIP_WIDTH;
+			blur_strip(target.pixels, image_height, target.stride, j, std::min(STRIP_WIDTH, image_width - j), target.kernel_sizes,
+					   passes, blur_cols, scratch + band * band_size, strip_size);
+		}
+	});
+}
+
+// Box or gaussian blurs of the plane of source into the targets with a kernel, same passes as blur_in_place()
+template <typename Pixel>
+static void blur_box_multi(const ImageView& source, const int plane, const std::vector<ImageView>& targets,
+						   const std::vector<int>& kernel_sizes, const BlurMode mode, const int threads, BlurWorkspace& workspace,
+						   BlurStats* stats)
+{
+	const ptrdiff_t pixel_size = sizeof(Pixel);
+	std::vector<MultiTarget<Pixel>> blurred;
+	int passes = 1;
+	for (size_t k = 0; k < targets.size(); k++)
+	{
+		if (kernel_sizes[k] > 0)
+		{
+			MultiTarget<Pixel> target;
+			target.pixels = reinterpret_cast<Pixel*>(targets[k].get_plane(plane));
+			target.stride = targets[k].stride / pixel_size;
+			passes = get_pass_sizes(kernel_sizes[k], mode, target.kernel_sizes);
+			blurred.push_back(target);
+		}
+	}
+
+	{
+		ScopedTimer timer(stats ? &stats->blur_rows : nullptr);
+		blur_rows_multi(reinterpret_cast<const Pixel*>(source.get_plane(plane)), source.stride / pixel_size, blurred, source.width,
+						source.height, passes, threads, BoxKernels<Pixel>::blur_rows, workspace, stats);
+	}
+	{
+		ScopedTimer timer(stats ? &stats->blur_cols : nullptr);
+		blur_cols_multi(blurred, source.width, source.height, passes, threads, BoxKernels<Pixel>::blur_cols, workspace, stats);
+	}
+}
+
+template <typename Pixel>
+static void blur_plane_multi(const ImageView& source, const int plane, const std::vector<ImageView>& targets,
+							 const std::vector<int>& kernel_sizes, const BlurMode mode, const int threads, BlurWorkspace& workspace,
+							 BlurStats* stats)
+{
+	if (mode == BlurMode::SAT)
+	{
+		blur_sat_multi<Pixel>(source, plane, targets, kernel_sizes, threads, workspace, stats);
+	}
+	else
+	{
+		blur_box_multi<Pixel>(source, plane, targets, kernel_sizes, mode, threads, workspace, stats);
+	}
+}
+
+void blur_image_multi(const ImageView& source, const std::vector<ImageView>& targets, const std::vector<float>& factors,
+					  int threads, BlurMode mode, BlurStats* stats, BlurWorkspace* workspace)
+{
+	if (targets.size() != factors.size())
+	{
+		throw std::invalid_argument("Every blur factor needs a target view");
+	}
+	if (threads < 1)
+	{
+		throw std::invalid_argument("Invalid thread count (it needs to be at least 1)");
+	}
+	if (!is_valid_view(source))
+	{
+		throw std::invalid_argument("Invalid image view (the stride needs to be a whole number of pixels, at least a row)");
+	}
+	for (const ImageView& target : targets)
+	{
+		if (!is_valid_view(target) || target.width != source.width || target.height != source.height ||
+			target.layout != source.layout)
+		{
+			throw std::invalid_argument("Invalid target views (same size and layout of the source, strides of whole pixels)");
+		}
+	}
+
+	std::vector<int> kernel_sizes(factors.size());
+	int max_kernel_size = 0;
+	for (size_t k = 0; k < factors.size(); k++)
+	{
+		kernel_sizes[k] = get_blur_kernel_size(source.width, source.height, factors[k]);
+		max_kernel_size = std::max(max_kernel_size, kernel_sizes[k]);
+	}
+
+	if (mode == BlurMode::APPROXIMATE || mode == BlurMode::REFERENCE)
+	{
+		// Every factor downsamples at a scale of its own, and the reference is only there to check the others
+		for (size_t k = 0; k < targets.size(); k++)
+		{
+			copy_pixels(source, targets[k]);
+			blur_image(targets[k], factors[k], threads, mode, stats, workspace);
+		}
+	}
+	else
+	{
+		ScopedTimer timer(stats ? &stats->blur : nullptr);
+		BlurWorkspace& scratch = workspace ? *workspace : get_thread_workspace();
+		for (size_t k = 0; k < targets.size(); k++)
+		{
+			if (kernel_sizes[k] <= 0)
+			{
+				copy_pixels(source, targets[k]);
+			}
+		}
+		if (max_kernel_size > 0)
+		{
+			if (source.layout == PixelLayout::RGBA_F32)
+			{
+				blur_plane_multi<RGBA>(source, 0, targets, kernel_sizes, mode, threads, scratch, stats);
+			}
+			else if (get_plane_count(source.layout) > 1)
+			{
+				const size_t scratch_bytes = stats ? stats->scratch_bytes : 0;
+				for (int p = 0; p < COLOR_PLANES; p++)
+				{
+					blur_plane_multi<float>(source, p, targets, kernel_sizes, mode, threads, scratch, stats);
+				}
+				if (stats)
+				{
+					stats->scratch_bytes = scratch_bytes + (stats->scratch_bytes - scratch_bytes) / COLOR_PLANES;
+				}
+				for (size_t k = 0; k < targets.size(); k++)
+				{
+					if (kernel_sizes[k] > 0)
+					{
+						set_opaque(targets[k], BlurRect{ 0, 0, source.width, source.height });
+					}
+				}
+			}
+			else if (source.layout == PixelLayout::GRAY8)
+			{
+				blur_plane_multi<uint8_t>(source, 0, targets, kernel_sizes, mode, threads, scratch, stats);
+			}
+			else
+			{
+				blur_plane_multi<uint32_t>(source, 0, targets, kernel_sizes, mode, threads, scratch, stats);
+			}
+		}
+	}
+	if (stats)
+	{
+		stats->kernel_size = max_kernel_size;
+		stats->pad = max_kernel_size / 2;
+	}
+}
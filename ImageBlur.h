@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct BlurStats;
+class BlurWorkspace;
+
+
+struct RGBA
+{
+	RGBA();
+	RGBA(float c, float a);
+	RGBA(float r, float g, float b, float a);
+
+	friend bool operator == (const RGBA& lhs, const RGBA& rhs);
+	friend bool operator != (const RGBA& lhs, const RGBA& rhs);
+	RGBA& operator += (const RGBA& rhs);
+	friend RGBA operator + (RGBA lhs, const RGBA& rhs);
+	RGBA& operator -= (const RGBA& rhs);
+	friend RGBA operator - (RGBA lhs, const RGBA& rhs);
+	RGBA& operator *= (const RGBA& rhs);
+	friend RGBA operator * (RGBA lhs, const RGBA& rhs);
+	RGBA& operator /= (const RGBA& rhs);
+	friend RGBA operator / (RGBA lhs, const RGBA& rhs);
+
+	float red;
+	float green;
+	float blue;
+	float alpha;
+};
+
+enum class BlurMode : uint8_t
+{
+	BOX,       // Separable running averages, the default
+	SAT,       // Summed area table, same cost per pixel at any kernel size
+	GAUSSIAN,  // Three box passes approximating a Gaussian with the variance of the box kernel
+	REFERENCE, // Whole kernel summed for every pixel, painfully slow, for sanity checking the others
+	APPROXIMATE // Box blur of a downsampled copy interpolated back up, see blur_image_approximate()
+};
+
+// Scale of the approximate mode as a fraction of the kernel size, see get_approximate_blur_scale()
+const float DEFAULT_BLUR_TOLERANCE = 0.05f;
+
+enum class PixelLayout : uint8_t
+{
+	BGRA8,    // 4 bytes per pixel, blue first (the TGA order), blurred with exact integer sums
+	RGBA8,    // Same, red first
+	RGBA_F32, // 4 floats per pixel (the RGBA struct), blurred with float sums
+	GRAY8,    // 1 byte per pixel, a single gray channel blurred with exact integer sums (never widened)
+	// Planar float images: a plane of height rows (stride bytes apart) for each channel, one right after the
+	// other, red first. Every plane is blurred on its own with the same float sums of RGBA_F32, and alpha (if
+	// there's a plane for it) comes out opaque like in the other layouts.
+	PLANAR_RGB_F32,
+	PLANAR_RGBA_F32
+};
+
+// Bytes of a pixel in a row, a single float for the planar layouts
+size_t get_pixel_size(PixelLayout layout);
+// 1 for the interleaved layouts
+int get_plane_count(PixelLayout layout);
+
+// Non-owning window on width x height pixels somebody else allocated, with rows stride bytes apart. The stride
+// has to be a whole number of pixels, 0 means rows are packed one right after the other.
+struct ImageView
+{
+	ImageView() = default;
+	ImageView(void* data, int width, int height, PixelLayout layout, ptrdiff_t stride = 0);
+
+	uint8_t* get_row(const int row) const { return data + static_cast<ptrdiff_t>(row) * stride; }
+	// Plane index of a planar view (0 is the whole view for the interleaved ones)
+	uint8_t* get_plane(const int plane) const { return data + static_cast<ptrdiff_t>(plane) * height * stride; }
+
+	uint8_t* data = nullptr;
+	int width = 0;
+	int height = 0;
+	ptrdiff_t stride = 0;
+	PixelLayout layout = PixelLayout::BGRA8;
+};
+
+// Rectangle of width x height pixels from column x and row y of a view (in the order the rows are in memory)
+struct BlurRect
+{
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
+// Maps the 0 < f < 1 blur factor to an odd kernel size for a width x height image, 0 or less means no blur at all
+int get_blur_kernel_size(int width, int height, float factor);
+
+// Blurs the pixels of the view where they are, the only extra memory is a few scratch lines (or the table of the
+// SAT mode). Alpha comes out opaque. Threads > 1 splits the work in bands, the result is bit-identical to the
+// single-threaded one. Stages are timed into stats when it's not null. The scratch memory comes from workspace,
+// or from one kept by the calling thread when it's null: either way it's only allocated when an image needs more
+// than the previous ones did.
+void blur_image(const ImageView& image, float factor, int threads = 1, BlurMode mode = BlurMode::BOX,
+				BlurStats* stats = nullptr, BlurWorkspace* workspace = nullptr);
+// Blurs only the pixels inside roi as the whole image blur would (same kernel size, mirrored at the edges of the
+// image and not of the rectangle: bit for bit with 8-bit views, up to float rounding with float ones) and leaves
+// the others untouched. Only the rectangle and the pad wide halo around it are read, so the cost goes with the
+// area of roi. Box and gaussian modes only.
+void blur_image(const ImageView& image, const BlurRect& roi, float factor, int threads = 1,
+				BlurMode mode = BlurMode::BOX, BlurStats* stats = nullptr, BlurWorkspace* workspace = nullptr);
+
+// Blurs source with every factor, into the target of the same index (same size and layout of source, their pixels
+// are overwritten), and leaves source as it is. The SAT mode builds a single table and gets every blur from it, the
+// box and gaussian modes mirror every source row once for all the row passes and run the column passes of all the
+// targets together, the approximate and reference ones blur a copy of source for each factor. Either way every
+// target comes out as blur_image() would make it. Stats get the largest kernel size.
+void blur_image_multi(const ImageView& source, const std::vector<ImageView>& targets, const std::vector<float>& factors,
+					  int threads = 1, BlurMode mode = BlurMode::BOX, BlurStats* stats = nullptr,
+					  BlurWorkspace* workspace = nullptr);
+
+// Approximation of the box blur for large kernels: the image is averaged down by a power of 2 scale, blurred there
+// with the kernel scaled down as well and interpolated back up (bilinear), so the work goes with the downsampled
+// area. tolerance is the largest scale allowed as a fraction of the kernel size (a low resolution pixel covers at
+// most that much of the kernel width): the scale is the largest power of 2 within it, 1 (the exact box blur) when
+// even 2 isn't. BlurMode::APPROXIMATE is this with DEFAULT_BLUR_TOLERANCE. Whole images only.
+int get_approximate_blur_scale(int width, int height, float factor, float tolerance = DEFAULT_BLUR_TOLERANCE);
+void blur_image_approximate(const ImageView& image, float factor, float tolerance = DEFAULT_BLUR_TOLERANCE, int threads = 1,
+							BlurStats* stats = nullptr, BlurWorkspace* workspace = nullptr);
+
+// Single box passes over a region, for callers keeping their own intermediate images (see IncrementalBlur): the
+// pixels of dst inside region get the horizontal (or vertical) running average of kernel_size pixels of src,
+// mirrored at the edges of src. src and dst have the same size and layout (strides can differ) and don't overlap.
+void blur_rows_region(const ImageView& src, const ImageView& dst, const BlurRect& region, int kernel_size, int threads = 1,
+					  BlurWorkspace* workspace = nullptr);
+void blur_cols_region(const ImageView& src, const ImageView& dst, const BlurRect& region, int kernel_size, int threads = 1,
+					  BlurWorkspace* workspace = nullptr);
+
+// Conversions between 8-bit BGR or BGRA pixels (bytes_per_pixel 3 or 4, the order of TGA files, 3 meaning opaque)
+// and float RGBA ones, with the vector kernels of the active instruction set and count split in bands across
+// threads. Encoding clamps to [0, 1] and rounds to the nearest value.
+void decode_bgr_pixels(const uint8_t* src, RGBA* dst, size_t count, int bytes_per_pixel, int threads = 1);
+void encode_bgr_pixels(const RGBA* src, uint8_t* dst, size_t count, int bytes_per_pixel, int threads = 1);
+// Same for the planes of a planar image, plane_size floats apart (red first, the alpha one is only read or written
+// with 4 bytes per pixel): count pixels from the start of each plane
+void decode_bgr_planes(const uint8_t* src, float* planes, size_t plane_size, size_t count, int bytes_per_pixel,
+					   int threads = 1);
+void encode_bgr_planes(const float* planes, size_t plane_size, uint8_t* dst, size_t count, int bytes_per_pixel,
+					   int threads = 1);
+
+// Reflect padded copy of a RGBA_F32 view, (width + 2 * pad) x (height + 2 * pad) packed pixels to delete[]
+RGBA* get_mirror_padded_image(const ImageView& image, int pad);
@@ -0,0 +1,72 @@
+#include "IncrementalBlur.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+
+
+IncrementalBlur::IncrementalBlur(const ImageView& source, const ImageView& target, float factor, int threads) :
+	source(source), target(target), kernel_size(get_blur_kernel_size(source.width, source.height, factor)), threads(threads)
+{
+	if (source.width != target.width || source.height != target.height || source.layout != target.layout)
+	{
+		throw std::invalid_argument("Source and target images need the same size and layout");
+	}
+
+	const BlurRect whole = { 0, 0, source.width, source.height };
+	if (kernel_size <= 0)
+	{
+		copy_source(whole);
+		return;
+	}
+
+	blurred_rows_buffer.resize(static_cast<size_t>(source.width) * source.height * get_pixel_size(source.layout) *
+							   get_plane_count(source.layout));
+	blurred_rows = ImageView(blurred_rows_buffer.data(), source.width, source.height, source.layout);
+	blur_rows_region(source, blurred_rows, whole, kernel_size, threads, &workspace);
+	blur_cols_region(blurred_rows, target, whole, kernel_size, threads, &workspace);
+}
+
+void IncrementalBlur::update(const BlurRect& dirty)
+{
+	const int first_col = std::max(0, dirty.x);
+	const int first_row = std::max(0, dirty.y);
+	const int last_col = std::min(source.width, dirty.x + dirty.width) - 1;
+	const int last_row = std::min(source.height, dirty.y + dirty.height) - 1;
+	if (first_col > last_col || first_row > last_row)
+	{
+		return;
+	}
+	if (kernel_size <= 0)
+	{
+		copy_source({ first_col, first_row, last_col - first_col + 1, last_row - first_row + 1 });
+		return;
+	}
+
+	// A changed pixel reaches pad pixels on each side, the mirrored ones past the edges are inside these already
+	const int pad = kernel_size / 2;
+	const int halo_first_col = std::max(0, first_col - pad);
+	const int halo_last_col = std::min(source.width - 1, last_col + pad);
+	const int halo_first_row = std::max(0, first_row - pad);
+	const int halo_last_row = std::min(source.height - 1, last_row + pad);
+
+	const int halo_width = halo_last_col - halo_first_col + 1;
+	blur_rows_region(source, blurred_rows, { halo_first_col, first_row, halo_width, last_row - first_row + 1 },
+					 kernel_size, threads, &workspace);
+	blur_cols_region(blurred_rows, target, { halo_first_col, halo_first_row, halo_width, halo_last_row - halo_first_row + 1 },
+					 kernel_size, threads, &workspace);
+}
+
+void IncrementalBlur::copy_source(const BlurRect& region)
+{
+	const size_t pixel_size = get_pixel_size(source.layout);
+	for (int p = 0; p < get_plane_count(source.layout); p++)
+	{
+		const ptrdiff_t source_offset = source.get_plane(p) - source.data;
+		const ptrdiff_t target_offset = target.get_plane(p) - target.data;
+		for (int i = region.y; i < region.y + region.height; i++)
+		{
+			memcpy(target.get_row(i) + target_offset + region.x * pixel_size, source.get_row(i) + source_offset + region.x * pixel_size,
+				   region.width * pixel_size);
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ImageBlur.h"
+#include "BlurWorkspace.h"
+#include <stdint.h>
+#include <vector>
+
+
+// Box blur of an image that keeps changing a little at a time (an editor re-blurring after every brush stroke).
+// The horizontal pass of the whole image is kept between calls: after an edit only the rows of it crossing the
+// edited rectangle are filtered again, and the vertical pass only runs on the pixels whose kernel reaches them,
+// so an update costs about (edit + 2 * pad)^2 pixels whatever the size of the image. Integer views stay bit for
+// bit equal to a fresh blur, float ones up to rounding (the running sums restart at the edge of the update).
+class IncrementalBlur
+{
+public:
+
+	// Blurs source into target right away. Both are kept as views: they need to stay valid, with the same size
+	// and layout, and not overlap.
+	IncrementalBlur(const ImageView& source, const ImageView& target, float factor, int threads = 1);
+
+	IncrementalBlur(const IncrementalBlur&) = delete;
+	IncrementalBlur& operator = (const IncrementalBlur&) = delete;
+
+	// The source pixels inside dirty changed: brings target up to date. dirty is clipped to the image.
+	void update(const BlurRect& dirty);
+
+	int get_kernel_size() const { return kernel_size; }
+
+private:
+
+	void copy_source(const BlurRect& region);
+
+	ImageView source;
+	ImageView target;
+	int kernel_size = 0;
+	int threads = 1;
+
+	std::vector<uint8_t> blurred_rows_buffer;
+	ImageView blurred_rows; // The horizontal pass, packed rows
+	BlurWorkspace workspace; // Scratch lines of the updates
+};
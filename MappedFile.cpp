@@ -0,0 +1,195 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path, Mode mode, size_t size)
+{
+	const bool write = (mode == Mode::READ_WRITE);
+	HANDLE handle = CreateFileA(path.c_str(), write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+								write ? 0 : FILE_SHARE_READ, nullptr, write ? CREATE_ALWAYS : OPEN_EXISTING,
+								FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	file = handle;
+
+	if (!write)
+	{
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(handle, &file_size))
+		{
+			unmap();
+			return;
+		}
+		size = static_cast<size_t>(file_size.QuadPart);
+	}
+	if (size == 0)
+	{
+		// Zero sized mappings aren't allowed
+		unmap();
+		return;
+	}
+
+	const unsigned long long mapping_size = size;
+	mapping = CreateFileMappingA(handle, nullptr, write ? PAGE_READWRITE : PAGE_READONLY,
+								 static_cast<DWORD>(mapping_size >> 32), static_cast<DWORD>(mapping_size & 0xFFFFFFFF), nullptr);
+	if (!mapping)
+	{
+		unmap();
+		return;
+	}
+	data = static_cast<uint8_t*>(MapViewOfFile(mapping, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+	if (!data)
+	{
+		unmap();
+		return;
+	}
+	this->size = size;
+}
+
+bool MappedFile::truncate(size_t new_size)
+{
+	// The end of a file can't move while a mapping of it is open
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+	if (!file)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER end;
+	end.QuadPart = static_cast<LONGLONG>(new_size);
+	return SetFilePointerEx(file, end, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+}
+
+void MappedFile::unmap()
+{
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mapping)
+	{
+		CloseHandle(mapping);
+	}
+	if (file)
+	{
+		CloseHandle(file);
+	}
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+	file = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path, Mode mode, size_t size)
+{
+	const bool write = (mode == Mode::READ_WRITE);
+	fd = open(path.c_str(), write ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+	if (fd < 0)
+	{
+		return;
+	}
+
+	if (write)
+	{
+		// The output is sized upfront, pages are then filled in straight by the encoder. Blocks are reserved
+		// too where possible, a full disk would otherwise only show up as a SIGBUS while writing the pixels
+		if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			unmap();
+			return;
+		}
+#ifdef __linux__
+		if (size > 0 && posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0)
+		{
+			unmap();
+			return;
+		}
+#endif
+	}
+	else
+	{
+		struct stat info;
+		if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+		{
+			unmap();
+			return;
+		}
+		size = static_cast<size_t>(info.st_size);
+	}
+	if (size == 0)
+	{
+		// Zero sized mappings aren't allowed
+		unmap();
+		return;
+	}
+
+	void* address = mmap(nullptr, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED)
+	{
+		unmap();
+		return;
+	}
+	// Both the decoder and the encoder walk the file front to back exactly once
+	madvise(address, size, MADV_SEQUENTIAL);
+	data = static_cast<uint8_t*>(address);
+	this->size = size;
+}
+
+bool MappedFile::truncate(size_t new_size)
+{
+	if (data)
+	{
+		munmap(data, size);
+	}
+	data = nullptr;
+	size = 0;
+	return fd >= 0 && ftruncate(fd, static_cast<off_t>(new_size)) == 0;
+}
+
+void MappedFile::unmap()
+{
+	if (data)
+	{
+		munmap(data, size);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	data = nullptr;
+	size = 0;
+	fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	unmap();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+
+// A whole file mapped in memory, read-only or (for READ_WRITE) created with the given size. Mapping can fail
+// for reasons the stream path doesn't care about (empty files, pipes, filesystems without mmap support...) so
+// the constructor never throws: callers check is_mapped() and fall back to the streams.
+class MappedFile
+{
+public:
+
+	enum class Mode : uint8_t
+	{
+		READ,
+		READ_WRITE
+	};
+
+	MappedFile(const std::string& path, Mode mode, size_t size = 0);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	bool is_mapped() const { return data != nullptr; }
+	uint8_t* get_data() const { return data; }
+	size_t get_size() const { return size; }
+
+	// Unmaps the file and cuts it to new_size bytes, for outputs mapped at their worst case size. Returns false when
+	// the file couldn't be cut (it's unmapped either way).
+	bool truncate(size_t new_size);
+
+private:
+
+	void unmap();
+
+	uint8_t* data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
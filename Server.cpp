@@ -0,0 +1,402 @@
+#include "Server.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+
+void run_server(const ServerOptions&, std::ostream&)
+{
+	throw std::runtime_error("Error: The server needs Unix domain sockets, it's not available on Windows");
+}
+
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <ios>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// Decoded images by path, least recently used last. An entry is only good as long as its file keeps the
+// modification time and the size it had when it was parsed.
+class ImageCache
+{
+public:
+
+	ImageCache(const size_t max_bytes, const BlurEngine engine) : max_bytes(max_bytes), engine(engine) {}
+
+	// The image of path, parsed again when it's not in the cache or its file changed (hit tells which one it was).
+	// Images evicted while a worker still uses them stay alive until it's done.
+	std::shared_ptr<const TGA> get(const std::string& path, bool& hit)
+	{
+		namespace fs = std::filesystem;
+		std::error_code error;
+		const fs::file_time_type mtime = fs::last_write_time(path, error);
+		const uintmax_t file_size = error ? 0 : fs::file_size(path, error);
+		if (error)
+		{
+			throw std::ios_base::failure("Unable to open file for reading");
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			const auto found = index.find(path);
+			if (found != index.end())
+			{
+				if (found->second->mtime == mtime && found->second->file_size == file_size)
+				{
+					entries.splice(entries.begin(), entries, found->second);
+					hit = true;
+					return found->second->image;
+				}
+				remove(found);
+			}
+		}
+
+		// Parsing happens outside the lock, two workers missing the same file at once just parse it twice
+		hit = false;
+		std::shared_ptr<TGA> image = std::make_shared<TGA>(engine);
+		image->parse(path);
+		const size_t image_bytes = image->get_pixel_bytes();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (image_bytes > max_bytes)
+		{
+			return image;
+		}
+		const auto found = index.find(path);
+		if (found != index.end())
+		{
+			remove(found);
+		}
+		entries.push_front({ path, mtime, file_size, image, image_bytes });
+		index[path] = entries.begin();
+		bytes += image_bytes;
+		while (bytes > max_bytes)
+		{
+			bytes -= entries.back().bytes;
+			index.erase(entries.back().path);
+			entries.pop_back();
+			evictions++;
+		}
+		return image;
+	}
+
+	void get_counters(size_t& count, size_t& size, long long& evicted) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		count = entries.size();
+		size = bytes;
+		evicted = evictions;
+	}
+
+private:
+
+	struct Entry
+	{
+		std::string path;
+		std::filesystem::file_time_type mtime;
+		uintmax_t file_size;
+		std::shared_ptr<const TGA> image;
+		size_t bytes;
+	};
+	using Index = std::unordered_map<std::string, std::list<Entry>::iterator>;
+
+	void remove(Index::iterator found)
+	{
+		bytes -= found->second->bytes;
+		entries.erase(found->second);
+		index.erase(found);
+	}
+
+	const size_t max_bytes;
+	const BlurEngine engine;
+
+	mutable std::mutex mutex;
+	std::list<Entry> entries;
+	Index index;
+	size_t bytes = 0;
+	long long evictions = 0;
+};
+
+// Latencies are the ones of the blur requests, from the request line to the output written
+struct ServerCounters
+{
+	long long connections = 0;
+	long long requests = 0;
+	long long hits = 0;
+	long long misses = 0;
+	long long failed = 0;
+	double latency_total = 0.0;
+	double latency_max = 0.0;
+};
+
+static void send_line(const int fd, const std::string& line)
+{
+	const std::string data = line + "\n";
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		const ssize_t count = ::send(fd, data.data() + sent, data.size() - sent, 0);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (count <= 0)
+		{
+			// The client went away, there's nobody left to tell
+			return;
+		}
+		sent += static_cast<size_t>(count);
+	}
+}
+
+// Next line sent on fd (without the newline), false once the client closed the connection
+static bool receive_line(const int fd, std::string& pending, std::string& line)
+{
+	size_t end = pending.find('\n');
+	while (end == std::string::npos)
+	{
+		char chunk[4096];
+		const ssize_t count = ::recv(fd, chunk, sizeof(chunk), 0);
+		if (count < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (count <= 0)
+		{
+			return false;
+		}
+		pending.append(chunk, static_cast<size_t>(count));
+		end = pending.find('\n');
+	}
+	line = pending.substr(0, end);
+	pending.erase(0, end + 1);
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.pop_back();
+	}
+	return true;
+}
+
+void run_server(const ServerOptions& options, std::ostream& log)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (options.socket_path.empty() || options.socket_path.size() >= sizeof(address.sun_path))
+	{
+		throw std::invalid_argument("Error: Invalid socket path (empty or too long)");
+	}
+	if (options.workers < 1)
+	{
+		throw std::invalid_argument("Error: Invalid worker count (it needs to be at least 1)");
+	}
+	strncpy(address.sun_path, options.socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+	// Writing to a client that disconnected must not kill the server
+	signal(SIGPIPE, SIG_IGN);
+
+	const int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		throw std::runtime_error("Error: Unable to create the server socket");
+	}
+	// A socket file left behind by a previous run would make bind fail
+	::unlink(options.socket_path.c_str());
+	if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 || ::listen(listener, 64) < 0)
+	{
+		::close(listener);
+		char buffer[200];
+		snprintf(buffer, sizeof(buffer), "Error: Unable to listen on %s (%s)", options.socket_path.c_str(), strerror(errno));
+		throw std::runtime_error(buffer);
+	}
+
+	ImageCache cache(options.cache_bytes, options.engine);
+	ServerCounters counters;
+	std::mutex counters_mutex;
+	std::atomic<bool> stopping(false);
+
+	std::deque<int> connections; // Accepted, waiting for a worker
+	std::vector<int> active;     // Being served
+	std::mutex connections_mutex;
+	std::condition_variable connections_ready;
+
+	auto get_stats_line = [&]()
+	{
+		size_t cached = 0;
+		size_t cached_bytes = 0;
+		long long evictions = 0;
+		cache.get_counters(cached, cached_bytes, evictions);
+		std::lock_guard<std::mutex> lock(counters_mutex);
+		const long long done = counters.requests - counters.failed;
+		char buffer[400];
+		snprintf(buffer, sizeof(buffer),
+				 "connections=%lld requests=%lld hits=%lld misses=%lld failed=%lld cached_images=%zu cached_bytes=%zu "
+				 "evictions=%lld latency_avg_ms=%.3f latency_max_ms=%.3f",
+				 counters.connections, counters.requests, counters.hits, counters.misses, counters.failed, cached,
+				 cached_bytes, evictions, done > 0 ? counters.latency_total / done * 1e3 : 0.0, counters.latency_max * 1e3);
+		return std::string(buffer);
+	};
+
+	auto handle_request = [&](const std::string& line, TGA& image)
+	{
+		std::istringstream fields(line);
+		std::string in_path, out_path;
+		float factor = -1.f;
+		if (!(fields >> in_path >> out_path >> factor))
+		{
+			return std::string("error Invalid request (<input> <output> <factor>, stats or shutdown)");
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		bool hit = false;
+		std::string error;
+		try
+		{
+			// The cached image is never blurred itself, every request works on its own copy
+			const std::shared_ptr<const TGA> source = cache.get(in_path, hit);
+			image.copy_from(*source);
+			image.blur(factor, 1, options.mode);
+			image.write(out_path);
+		}
+		catch (std::exception& e)
+		{
+			error = e.what();
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(counters_mutex);
+		counters.requests++;
+		if (!error.empty())
+		{
+			counters.failed++;
+			log << "Failed " << in_path << ": " << error << std::endl;
+			return "error " + error;
+		}
+		(hit ? counters.hits : counters.misses)++;
+		counters.latency_total += seconds;
+		counters.latency_max = std::max(counters.latency_max, seconds);
+		char buffer[100];
+		snprintf(buffer, sizeof(buffer), "ok %s %.3f", hit ? "hit" : "miss", seconds * 1e3);
+		return std::string(buffer);
+	};
+
+	auto worker = [&]()
+	{
+		// Like the batch workers, the output image (and its pixel buffer) is reused from request to request
+		TGA image(options.engine);
+		while (true)
+		{
+			int fd = -1;
+			{
+				std::unique_lock<std::mutex> lock(connections_mutex);
+				connections_ready.wait(lock, [&]() { return !connections.empty() || stopping; });
+				if (connections.empty())
+				{
+					return;
+				}
+				fd = connections.front();
+				connections.pop_front();
+				active.push_back(fd);
+			}
+
+			std::string pending, line;
+			while (receive_line(fd, pending, line))
+			{
+				if (line.empty())
+				{
+					continue;
+				}
+				if (line == "stats")
+				{
+					send_line(fd, get_stats_line());
+				}
+				else if (line == "shutdown")
+				{
+					send_line(fd, "ok");
+					stopping = true;
+					connections_ready.notify_all();
+					break;
+				}
+				else
+				{
+					send_line(fd, handle_request(line, image));
+				}
+			}
+			std::lock_guard<std::mutex> lock(connections_mutex);
+			active.erase(std::find(active.begin(), active.end(), fd));
+			::close(fd);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve(options.workers);
+	for (int w = 0; w < options.workers; w++)
+	{
+		pool.emplace_back(worker);
+	}
+	log << "Listening on " << options.socket_path << " with " << options.workers << " workers" << std::endl;
+
+	// Polling with a timeout lets the accept loop notice a shutdown request
+	while (!stopping)
+	{
+		pollfd listening = { listener, POLLIN, 0 };
+		if (::poll(&listening, 1, 200) <= 0)
+		{
+			continue;
+		}
+		const int fd = ::accept(listener, nullptr, nullptr);
+		if (fd < 0)
+		{
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> lock(counters_mutex);
+			counters.connections++;
+		}
+		std::lock_guard<std::mutex> lock(connections_mutex);
+		connections.push_back(fd);
+		connections_ready.notify_one();
+	}
+
+	::close(listener);
+	::unlink(options.socket_path.c_str());
+	{
+		// Connections still waiting for a worker are dropped, the ones being served get their current request
+		// answered and no more
+		std::lock_guard<std::mutex> lock(connections_mutex);
+		for (const int fd : connections)
+		{
+			::close(fd);
+		}
+		connections.clear();
+		for (const int fd : active)
+		{
+			::shutdown(fd, SHUT_RD);
+		}
+	}
+	connections_ready.notify_all();
+	for (std::thread& t : pool)
+	{
+		t.join();
+	}
+	log << get_stats_line() << std::endl;
+}
+
+#endif
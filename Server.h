@@ -0,0 +1,28 @@
+#pragma once
+
+#include "BlurringFilter.h"
+#include <stddef.h>
+#include <ostream>
+#include <string>
+
+
+struct ServerOptions
+{
+	std::string socket_path;
+	int workers = 1;
+	BlurEngine engine = BlurEngine::FLOAT;
+	BlurMode mode = BlurMode::BOX;
+	// Decoded images kept around for the next requests, least recently used ones go first
+	size_t cache_bytes = static_cast<size_t>(512) << 20;
+};
+
+// Serves blur requests on a Unix domain socket until a shutdown request comes. Every connection is handled by one
+// of the workers and can send any number of requests, one per line, each answered with one line:
+//
+//   <input> <output> <factor>   ok hit|miss <milliseconds>, or error <message>
+//   stats                       key=value counters: requests, cache hits and misses, latencies...
+//   shutdown                    ok, then the server stops once the requests in flight are done
+//
+// Decoded inputs are cached by path, and used again as long as the file keeps the same modification time and
+// size. Connections and failures are reported on log.
+void run_server(const ServerOptions& options, std::ostream& log);
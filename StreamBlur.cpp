@@ -0,0 +1,124 @@
+#include "StreamBlur.h"
+#include "BlurKernels.h"
+#include <algorithm>
+#include <stdexcept>
+
+
+StreamBlur::StreamBlur(const int width, const int height, const int kernel_size) :
+	width(width), height(height), kernel_size(kernel_size), pad(kernel_size / 2)
+{
+	if (kernel_size > 0 && (pad >= width || pad >= height))
+	{
+		throw std::invalid_argument("Pad size cannot exceed the dimensions of the image");
+	}
+	if (kernel_size > 0)
+	{
+		line.resize(static_cast<size_t>(width) + 2 * pad);
+		ring.resize(static_cast<size_t>(kernel_size + 1) * width);
+		sums.resize(width);
+		out.resize(width);
+	}
+}
+
+size_t StreamBlur::get_scratch_bytes() const
+{
+	return (line.size() + ring.size() + sums.size() + out.size()) * sizeof(RGBA);
+}
+
+RGBA* StreamBlur::get_ring_row(const int row)
+{
+	// Rows past the edges are the mirrored ones (reflect padding), they're always still in the ring
+	int mirr_row = row;
+	if (row < 0)
+	{
+		mirr_row = -row;
+	}
+	else if (row >= height)
+	{
+		mirr_row = 2 * height - 2 - row;
+	}
+	return ring.data() + static_cast<ptrdiff_t>(mirr_row % (kernel_size + 1)) * width;
+}
+
+void StreamBlur::push_row(const RGBA* row, const RowCallback& emit)
+{
+	if (rows_in >= height)
+	{
+		throw std::out_of_range("Too many rows pushed to the stream blur");
+	}
+	const int r = rows_in++;
+
+	if (kernel_size <= 0)
+	{
+		// Nothing to blur
+		rows_out++;
+		emit(row);
+		return;
+	}
+
+	for (int j = 0; j < pad; j++)
+	{
+		line[j] = row[pad - j];
+		line[pad + width + j] = row[width - 2 - j];
+	}
+	std::copy(row, row + width, line.begin() + pad);
+	get_blur_kernels().blur_rows(line.data(), 0, get_ring_row(r), 0, 1, width, kernel_size);
+
+	if (r == pad)
+	{
+		// The first window (mirrored rows -pad..pad) is complete, summed in the same order the column pass uses
+		std::fill(sums.begin(), sums.end(), RGBA(0.f, 1.f));
+		float* s = &sums[0].red;
+		for (int v = -pad; v <= pad; v++)
+		{
+			const float* in = &get_ring_row(v)->red;
+			for (int c = 0; c < 4 * width; c++)
+			{
+				s[c] += in[c];
+			}
+		}
+		for (int c = 0; c < 4 * width; c++)
+		{
+			(&out[0].red)[c] = s[c] / static_cast<float>(kernel_size);
+		}
+		for (RGBA& pixel : out)
+		{
+			pixel.alpha = 1.f;
+		}
+		rows_out++;
+		emit(out.data());
+	}
+	while (rows_out > 0 && rows_out + pad <= r)
+	{
+		step(emit);
+	}
+	if (r == height - 1)
+	{
+		// The bottom rows only need the mirrored ones, which are all in already
+		while (rows_out < height)
+		{
+			step(emit);
+		}
+	}
+}
+
+void StreamBlur::step(const RowCallback& emit)
+{
+	const int y = rows_out;
+	float* s = &sums[0].red;
+	const float* in = &get_ring_row(y + pad)->red;
+	const float* leaving = &get_ring_row(y - pad - 1)->red;
+	float* dst = &out[0].red;
+	// Written on plain floats so the compiler can vectorize it, the op order is the one of the column kernels
+	for (int c = 0; c < 4 * width; c++)
+	{
+		s[c] = s[c] + in[c] - leaving[c];
+		dst[c] = s[c] / static_cast<float>(kernel_size);
+	}
+	for (RGBA& pixel : out)
+	{
+		pixel.alpha = 1.f;
+	}
+	rows_out++;
+	emit(out.data());
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ImageBlur.h"
+#include <functional>
+#include <vector>
+
+
+// Row by row version of the float box blur, for images that don't fit in memory. Source rows are pushed in
+// order (top to bottom or bottom to top, the filter is symmetric so it doesn't matter) and every output row is
+// handed to the callback as soon as the rows it depends on are in. Only kernel_size + 1 horizontally blurred
+// rows are kept around, in a ring, so the memory needed is O(kernel_size * width) whatever the image height.
+// The result is bit-identical to TGA::blur on the whole image.
+class StreamBlur
+{
+public:
+
+	using RowCallback = std::function<void(const RGBA* row)>;
+
+	StreamBlur(const int width, const int height, const int kernel_size);
+
+	void push_row(const RGBA* row, const RowCallback& emit);
+
+	int get_rows_in() const { return rows_in; }
+	int get_rows_out() const { return rows_out; }
+	// Bytes held by the line, ring, sums and out buffers
+	size_t get_scratch_bytes() const;
+
+private:
+
+	RGBA* get_ring_row(const int row);
+	// Slides the vertical sums one row down and emits the output row
+	void step(const RowCallback& emit);
+
+	int width = 0;
+	int height = 0;
+	int kernel_size = 0;
+	int pad = 0;
+
+	int rows_in = 0;
+	int rows_out = 0;
+
+	std::vector<RGBA> line; // Source row with its mirrored borders
+	std::vector<RGBA> ring; // Last kernel_size + 1 horizontally blurred rows
+	std::vector<RGBA> sums; // Vertical running sums, one per column
+	std::vector<RGBA> out;
+};
@@ -1,8 +1,17 @@
 #include "BlurringFilter.h"
+#include "BlurKernels.h"
+#include "Batch.h"
+#include "Server.h"
+#include "BlurStats.h"
+#include "BlurWorkspace.h"
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
+#include <algorithm>
+#include <typeinfo>
+#include <stdio.h>
 
 
 int main(int argc, char** argv)
@@ -12,39 +21,319 @@ int main(int argc, char** argv)
 		// Parsing options
 		std::vector<std::string> args(argv + 1, argv + argc);
 		std::string in_file_path, out_file_path;
-		float factor;
-
-		if (args.size() != 6)
-		{
-			char buffer[100];
-			sprintf_s(buffer, "Error: Found %d arguments, a number of 3 is expected", static_cast<int>(args.size()));
-			throw std::invalid_argument(buffer);
-		}
+		float factor = -1.f;
+		// Every factor of -f a,b,c, as written and as a number
+		std::vector<std::string> factor_names;
+		std::vector<float> factors;
+		int threads = 1;
+		BlurEngine engine = BlurEngine::FLOAT;
+		BlurMode mode = BlurMode::BOX;
+		bool stream = false;
+		bool huge_pages = false;
+		bool has_roi = false;
+		bool raw = false;
+		RawFormat raw_format;
+		float tolerance = DEFAULT_BLUR_TOLERANCE;
+		BlurRect roi = {};
+		StatsFormat stats_format = StatsFormat::NONE;
+		std::string batch_path;
+		std::string socket_path;
+		size_t cache_mb = 512;
 
 		for (std::size_t i = 0; i < args.size(); i++)
 		{
 			if (args[i] == "-h" || args[i] == "--help")
 			{
-				std::cout << "Syntax: BlurringFilter -f <blur_factor> -i <infile> -o <outfile>" << std::endl;
+				std::cout << "Syntax: BlurringFilter -f <blur_factor>[,<blur_factor>...] -i <infile> -o <outfile> [-j <threads>] [--isa <isa>] [--engine float|int|planar] [--mode box|sat|gaussian|reference|approx [--tolerance <t>]] [--roi x,y,w,h] [--stream | --raw WxHxC] [--huge-pages] [--stats[=json]]" << std::endl;
+				std::cout << "        BlurringFilter --batch <manifest> [-j <threads>] [--engine float|int|planar]" << std::endl;
+				std::cout << "        BlurringFilter --batch <directory> -f <blur_factor> -o <outdir> [-j <threads>] [--engine float|int|planar]" << std::endl;
+				std::cout << "        BlurringFilter --serve <socket> [-j <threads>] [--engine float|int|planar] [--mode <mode>] [--cache-mb <megabytes>]" << std::endl;
+				std::cout << "        -j 0 uses every available hardware thread (default is 1)" << std::endl;
+				std::cout << "        --isa scalar|sse4.1|avx2|avx512|auto overrides the detected instruction set (" 
+						  << get_blur_isa_name(detect_blur_isa()) << ")" << std::endl;
+				std::cout << "        --engine int keeps 8-bit pixels with exact integer sums, 4x less memory than float" << std::endl;
+				std::cout << "        --engine planar blurs like float, on a plane per channel (no alpha plane for 24 bit images)" << std::endl;
+				std::cout << "        --mode sat blurs through a summed area table (same speed at any factor), --mode reference" << std::endl;
+				std::cout << "               sums the whole kernel for every pixel (very slow, for checking the other modes)," << std::endl;
+				std::cout << "               --mode gaussian approximates a Gaussian of the same width with three box passes," << std::endl;
+				std::cout << "               --mode approx box blurs a downsampled copy and interpolates it back, for large factors" << std::endl;
+				std::cout << "        --tolerance largest downsampling of --mode approx as a fraction of the kernel size (default 0.05)" << std::endl;
+				std::cout << "        --roi blurs only the rectangle w x h from x,y (from the top left corner), leaving the rest as is" << std::endl;
+				std::cout << "        -f 0.1,0.5,1 blurs the image once for every factor, %f in <outfile> is replaced by each one" << std::endl;
+				std::cout << "        -i - and -o - read the image from the standard input and write it to the standard output" << std::endl;
+				std::cout << "        --stream blurs the image a few rows at a time, for images that don't fit in memory" << std::endl;
+				std::cout << "        --raw streams headerless frames of W x H pixels of C (3 or 4) bytes one after the other instead" << std::endl;
+				std::cout << "        --huge-pages backs the large scratch buffers with huge pages where the OS offers them" << std::endl;
+				std::cout << "        --batch blurs every .tga of a directory, or every \"infile outfile blur_factor\" line of a manifest," << std::endl;
+				std::cout << "                one image per thread" << std::endl;
+				std::cout << "        --serve answers \"infile outfile blur_factor\" requests on a Unix socket with -j workers, keeping up to" << std::endl;
+				std::cout << "                --cache-mb (default 512) of decoded images around (see BlurringClient)" << std::endl;
+				std::cout << "        --stats prints the timings and memory of every image on stderr, one line of key=value pairs" << std::endl;
+				std::cout << "                (--stats=json for one JSON object per line)" << std::endl;
 				return 0;
 			}
+			else if (args[i] == "--stream")
+			{
+				stream = true;
+			}
+			else if (args[i] == "--huge-pages")
+			{
+				huge_pages = true;
+			}
+			else if (args[i] == "--stats")
+			{
+				stats_format = StatsFormat::TEXT;
+			}
+			else if (args[i].compare(0, 8, "--stats=") == 0)
+			{
+				stats_format = parse_stats_format(args[i].substr(8));
+			}
+			else if (i + 1 >= args.size())
+			{
+				char buffer[100];
+				snprintf(buffer, sizeof(buffer), "Error: Option %s is unknown or is missing its value", args[i].c_str());
+				throw std::invalid_argument(buffer);
+			}
 			else if (args[i] == "-f")
 			{
-				factor = std::stof(args[i + 1]);
+				const std::string value = args[++i];
+				factor_names.clear();
+				factors.clear();
+				for (size_t start = 0; start <= value.size(); )
+				{
+					const size_t end = std::min(value.find(',', start), value.size());
+					factor_names.push_back(value.substr(start, end - start));
+					factors.push_back(std::stof(factor_names.back()));
+					start = end + 1;
+				}
+				factor = factors.front();
+			}
+			else if (args[i] == "--tolerance")
+			{
+				tolerance = std::stof(args[++i]);
 			}
 			else if (args[i] == "-i")
 			{
-				in_file_path = args[i + 1];
+				in_file_path = args[++i];
 			}
 			else if (args[i] == "-o")
 			{
-				out_file_path = args[i + 1];
+				out_file_path = args[++i];
+			}
+			else if (args[i] == "-j")
+			{
+				threads = std::stoi(args[++i]);
+				if (threads == 0)
+				{
+					threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+				}
+			}
+			else if (args[i] == "--mode")
+			{
+				const std::string name = args[++i];
+				if (name == "box")
+				{
+					mode = BlurMode::BOX;
+				}
+				else if (name == "sat")
+				{
+					mode = BlurMode::SAT;
+				}
+				else if (name == "gaussian")
+				{
+					mode = BlurMode::GAUSSIAN;
+				}
+				else if (name == "reference")
+				{
+					mode = BlurMode::REFERENCE;
+				}
+				else if (name == "approx")
+				{
+					mode = BlurMode::APPROXIMATE;
+				}
+				else
+				{
+					char buffer[100];
+					snprintf(buffer, sizeof(buffer), "Error: Unknown mode %s (box, sat, gaussian, reference, approx)", name.c_str());
+					throw std::invalid_argument(buffer);
+				}
+			}
+			else if (args[i] == "--roi")
+			{
+				const std::string value = args[++i];
+				char extra = 0;
+				if (sscanf(value.c_str(), "%d,%d,%d,%d%c", &roi.x, &roi.y, &roi.width, &roi.height, &extra) != 4)
+				{
+					char buffer[100];
+					snprintf(buffer, sizeof(buffer), "Error: Invalid region %s (x,y,w,h)", value.c_str());
+					throw std::invalid_argument(buffer);
+				}
+				has_roi = true;
+			}
+			else if (args[i] == "--raw")
+			{
+				const std::string value = args[++i];
+				char extra = 0;
+				if (sscanf(value.c_str(), "%dx%dx%d%c", &raw_format.width, &raw_format.height, &raw_format.channels, &extra) != 3)
+				{
+					char buffer[100];
+					snprintf(buffer, sizeof(buffer), "Error: Invalid raw format %s (WxHxC)", value.c_str());
+					throw std::invalid_argument(buffer);
+				}
+				raw = true;
+			}
+			else if (args[i] == "--batch")
+			{
+				batch_path = args[++i];
+			}
+			else if (args[i] == "--serve")
+			{
+				socket_path = args[++i];
+			}
+			else if (args[i] == "--cache-mb")
+			{
+				cache_mb = static_cast<size_t>(std::stoul(args[++i]));
+			}
+			else if (args[i] == "--isa")
+			{
+				set_blur_isa(parse_blur_isa(args[++i]));
+			}
+			else if (args[i] == "--engine")
+			{
+				const std::string name = args[++i];
+				if (name != "float" && name != "int" && name != "planar")
+				{
+					char buffer[100];
+					snprintf(buffer, sizeof(buffer), "Error: Unknown engine %s (float, int, planar)", name.c_str());
+					throw std::invalid_argument(buffer);
+				}
+				engine = (name == "int" ? BlurEngine::INTEGER : name == "planar" ? BlurEngine::PLANAR : BlurEngine::FLOAT);
+			}
+			else
+			{
+				char buffer[100];
+				snprintf(buffer, sizeof(buffer), "Error: Unknown option %s", args[i].c_str());
+				throw std::invalid_argument(buffer);
+			}
+		}
+
+		if (has_roi && (stream || raw || !batch_path.empty() || !socket_path.empty()))
+		{
+			throw std::invalid_argument("Error: --roi is not available with --stream, --raw, --batch or --serve");
+		}
+		if (huge_pages && (stream || raw || !batch_path.empty() || !socket_path.empty()))
+		{
+			throw std::invalid_argument("Error: --huge-pages is not available with --stream, --raw, --batch or --serve");
+		}
+		if (tolerance != DEFAULT_BLUR_TOLERANCE && (mode != BlurMode::APPROXIMATE || !batch_path.empty() || !socket_path.empty()))
+		{
+			throw std::invalid_argument("Error: --tolerance only applies to single images blurred with --mode approx");
+		}
+
+		// Several factors, or a single one named in the output path
+		const bool multi = (factors.size() > 1 || out_file_path.find("%f") != std::string::npos);
+		if (multi && (stream || raw || has_roi || !batch_path.empty() || !socket_path.empty()))
+		{
+			throw std::invalid_argument("Error: Multiple factors are not available with --stream, --raw, --roi, --batch or --serve");
+		}
+		if (factors.size() > 1 && out_file_path.find("%f") == std::string::npos)
+		{
+			throw std::invalid_argument("Error: Multiple factors need %f in the output path");
+		}
+
+		if (!socket_path.empty())
+		{
+			ServerOptions options;
+			options.socket_path = socket_path;
+			options.workers = threads;
+			options.engine = engine;
+			options.mode = mode;
+			options.cache_bytes = cache_mb << 20;
+			run_server(options, std::cerr);
+			return 0;
+		}
+
+		if (!batch_path.empty())
+		{
+			const std::vector<BatchJob> jobs = read_batch_jobs(batch_path, out_file_path, factor);
+			const BatchTotals totals = run_batch(jobs, threads, engine, mode, std::cerr, stats_format);
+
+			char buffer[200];
+			snprintf(buffer, sizeof(buffer), "%d images blurred, %d failed in %.3f s (%.1f images/s, %.1f MPix/s)",
+					 totals.done, totals.failed, totals.seconds, totals.done / std::max(totals.seconds, 1e-9),
+					 totals.pixels / std::max(totals.seconds, 1e-9) / 1e6);
+			std::cout << buffer << std::endl;
+			return totals.failed == 0 ? 0 : 1;
+		}
+
+		if (in_file_path.empty() || out_file_path.empty() || factor < 0.f)
+		{
+			throw std::invalid_argument("Error: Options -f, -i and -o are mandatory");
+		}
+
+		if (stream || raw)
+		{
+			if (engine != BlurEngine::FLOAT || mode != BlurMode::BOX)
+			{
+				throw std::invalid_argument("Error: --stream and --raw are only available with the float engine and the box mode");
 			}
+			BlurStats stats;
+			if (raw)
+			{
+				blur_raw_stream(in_file_path, out_file_path, raw_format, factor, stats_format != StatsFormat::NONE ? &stats : nullptr);
+			}
+			else
+			{
+				TGA::blur_stream(in_file_path, out_file_path, factor, stats_format != StatsFormat::NONE ? &stats : nullptr);
+			}
+			if (stats_format != StatsFormat::NONE)
+			{
+				std::cerr << format_stats(stats, stats_format, in_file_path) << std::endl;
+			}
+			return 0;
 		}
 
-		TGA* img = new TGA(in_file_path);
-		img->blur(factor);
-		img->write(out_file_path);
+		BlurStats stats;
+		BlurWorkspace workspace(huge_pages);
+		TGA* img = new TGA(engine);
+		img->set_workspace(&workspace);
+		img->set_threads(threads);
+		img->set_tolerance(tolerance);
+		if (stats_format != StatsFormat::NONE)
+		{
+			img->set_stats(&stats);
+		}
+		img->parse(in_file_path);
+		if (multi)
+		{
+			std::vector<std::string> out_paths;
+			for (const std::string& name : factor_names)
+			{
+				std::string path = out_file_path;
+				for (size_t pos = path.find("%f"); pos != std::string::npos; pos = path.find("%f", pos + name.size()))
+				{
+					path.replace(pos, 2, name);
+				}
+				out_paths.push_back(path);
+			}
+			img->blur_multi(factors, out_paths, threads, mode);
+		}
+		else if (has_roi)
+		{
+			img->blur(roi, factor, threads, mode);
+		}
+		else
+		{
+			img->blur(factor, threads, mode);
+		}
+		if (!multi)
+		{
+			img->write(out_file_path);
+		}
+		if (stats_format != StatsFormat::NONE)
+		{
+			std::cerr << format_stats(stats, stats_format, in_file_path) << std::endl;
+		}
 
 		return 0;
 	}